@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE (64 * 1024)        // size of a block, larger allocations get a block of their own
+#define ARENA_ALIGN 16                      // alignment of every allocation
+
+/*
+A bump allocator: memory is handed out from large blocks and never freed one allocation at a time.
+arena_reset releases everything at once, keeping the first block so the next user allocates nothing.
+*/
+
+void* arena_alloc(Arena* arena, size_t size) {
+    /*
+    Returns size bytes owned by the arena, valid until the next arena_reset.
+    */
+    ArenaBlock* block = arena->blocks;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    // current block is full, start a new one
+    if (block == NULL || block->used + size > block->size) {
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL) {
+            abort();
+        }
+        block->next = arena->blocks;
+        block->size = block_size;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    void* memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+char* arena_strdup(Arena* arena, char* s) {
+    // Copies s into the arena
+    size_t len = strlen(s) + 1;
+    return memcpy(arena_alloc(arena, len), s, len);
+}
+
+void arena_reset(Arena* arena) {
+    /*
+    Frees everything allocated from the arena, only its first block is kept for reuse.
+    */
+    ArenaBlock* block = arena->blocks;
+
+    if (block == NULL) {
+        return;
+    }
+    while (block->next != NULL) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    block->used = 0;
+    arena->blocks = block;
+}
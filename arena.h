@@ -0,0 +1,21 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;    // previously filled block
+    size_t size;                // bytes available in data
+    size_t used;                // bytes handed out from data
+    _Alignas(16) char data[];   // aligned like ARENA_ALIGN, malloc returns memory aligned at least as much
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* blocks;         // block being filled, NULL until the first allocation
+} Arena;
+
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strdup(Arena* arena, char* s);
+void arena_reset(Arena* arena);
+
+#endif
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Measures commands per second for an echo-heavy script, with echo run inside the shell and as a program.
+#
+# Usage: bench/builtin_bench.sh [path/to/smallsh] [num_commands]
+#
+# Both scripts print the same lines; the second calls /bin/echo by path, which skips the built-in and starts a
+# process for every line as the shell did before echo was a built-in. Output goes to /dev/null through a
+# redirection on every line, so the in-process case also pays for saving and restoring stdout.
+
+SMALLSH=${1:-./smallsh}
+NUM_COMMANDS=${2:-20000}
+ECHO_PATH=$(type -P echo)
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+run() {
+    # prints commands per second for a script of NUM_COMMANDS lines running $1
+    awk -v n="$NUM_COMMANDS" -v cmd="$1" 'BEGIN {
+            for (i = 1; i <= n; i++) print cmd " line " i " of the script > /dev/null"
+        }' > "$dir/script"
+    local start=$(date +%s%N)
+    SMALLSH_CACHE_DIR="$dir" "$SMALLSH" "$dir/script" > /dev/null
+    local end=$(date +%s%N)
+    awk -v n="$NUM_COMMANDS" -v ns=$((end - start)) 'BEGIN { printf "%.0f", n / (ns / 1e9) }'
+}
+
+echo "mode,commands,commands_per_s"
+echo "built-in,$NUM_COMMANDS,$(run echo)"
+echo "process,$NUM_COMMANDS,$(run "$ECHO_PATH")"
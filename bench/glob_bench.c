@@ -0,0 +1,101 @@
+/*
+Pathname expansion benchmark: matches patterns against a directory of many entries, reading the directory for
+every pattern, with the directory cache shared by two patterns, and with glob(3) for comparison.
+
+Compiling
+    gcc -o glob_bench bench/glob_bench.c pathglob.c arena.c stats.c -I. -std=c11 -Wall -Werror -O2
+
+Running
+    ./glob_bench [entries] [iterations]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+#include "arena.h"
+#include "pathglob.h"
+
+double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void run_case(char* name, char* first, char* second, int cached, int iterations, int entries) {
+    /*
+    Expands first and, if given, second iterations times and prints the time per iteration.
+    cached == 1 shares the directory listing between the two patterns.
+    */
+    Arena arena = {NULL};
+    char** paths;
+    int matches = 0;
+    int i;
+
+    double start = now_ms();
+    for (i = 0; i < iterations; i++) {
+        matches = expand_pattern(first, &paths, &arena);
+        if (second) {
+            // without the cache the second pattern reads the directory again
+            if (!cached) {
+                forget_directories();
+            }
+            matches += expand_pattern(second, &paths, &arena);
+        }
+        forget_directories();
+        arena_reset(&arena);
+    }
+    printf("%s,%d,%d,%.2f\n", name, entries, matches, (now_ms() - start) / iterations);
+}
+
+void run_libc(char* pattern, int iterations, int entries) {
+    // Expands pattern with glob(3), which reads the directory with readdir
+    glob_t result;
+    int matches = 0;
+    int i;
+
+    double start = now_ms();
+    for (i = 0; i < iterations; i++) {
+        glob(pattern, 0, NULL, &result);
+        matches = result.gl_pathc;
+        globfree(&result);
+    }
+    printf("glob(3) %s,%d,%d,%.2f\n", pattern, entries, matches, (now_ms() - start) / iterations);
+}
+
+int main(int argc, char* argv[]) {
+    int entries = argc > 1 ? atoi(argv[1]) : 100000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    char dir[] = "/tmp/glob_benchXXXXXX";
+    char name[32];
+    int i;
+
+    // half the entries end with .log, half with .txt
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0) {
+        perror(dir);
+        return 1;
+    }
+    for (i = 0; i < entries; i++) {
+        sprintf(name, "file%07d.%s", i, i % 2 ? "txt" : "log");
+        close(open(name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+    }
+
+    printf("case,entries,matches,ms_per_iteration\n");
+    run_case("*.log", "*.log", NULL, 0, iterations, entries);
+    run_case("file00012??.*", "file00012??.*", NULL, 0, iterations, entries);
+    run_case("[!f]*", "[!f]*", NULL, 0, iterations, entries);
+    run_case("*.log *.txt uncached", "*.log", "*.txt", 0, iterations, entries);
+    run_case("*.log *.txt cached", "*.log", "*.txt", 1, iterations, entries);
+    run_libc("*.log", iterations, entries);
+
+    for (i = 0; i < entries; i++) {
+        sprintf(name, "file%07d.%s", i, i % 2 ? "txt" : "log");
+        unlink(name);
+    }
+    chdir("/");
+    rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Measures how fast smallsh ingests a command stream piped to it, in lines per second.
+#
+# Usage: bench/ingest_bench.sh [path/to/smallsh] [num_lines]
+#
+# The stream is generated into a file first so the generator isn't measured, then piped to the shell through cat
+# as a generated stream would be. The comment stream is read and skipped without running anything, so it measures
+# the reader and the prompt alone; the true stream also parses and runs the true utility on every line. Neither
+# ends with exit, the shell exits at the end of input.
+
+SMALLSH=${1:-./smallsh}
+NUM_LINES=${2:-10000000}
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+run() {
+    # prints lines per second for a stream of NUM_LINES copies of $1
+    awk -v n="$NUM_LINES" -v line="$1" 'BEGIN { for (i = 1; i <= n; i++) print line }' > "$dir/stream"
+    local start=$(date +%s%N)
+    cat "$dir/stream" | "$SMALLSH" > /dev/null
+    local status=$?
+    local end=$(date +%s%N)
+    if [ $status -ne 0 ]; then
+        echo "ingest_bench: $SMALLSH exited with $status" >&2
+        exit 1
+    fi
+    awk -v n="$NUM_LINES" -v ns=$((end - start)) 'BEGIN { printf "%.0f", n / (ns / 1e9) }'
+}
+
+echo "stream,lines,lines_per_s"
+echo "comment,$NUM_LINES,$(run '# a comment line of the stream')"
+echo "true,$NUM_LINES,$(run 'true')"
@@ -0,0 +1,50 @@
+#!/bin/bash
+# Checks how command lists run: which commands of a line run, in what order, and with which status.
+#
+# Usage: bench/list_check.sh [path/to/smallsh]
+#
+# Every case runs under smallsh -c and compares what the commands wrote with the output expected. The notices
+# of background processes and of the jobs ended at exit are left out, their pids and timing differ from run
+# to run.
+
+SMALLSH=${1:-./smallsh}
+failed=0
+
+check() {
+    # check expected commands: runs commands and compares their output with expected
+    local expected=$1
+    local cmd=$2
+    local out=$("$SMALLSH" -c "$cmd" 2>&1 | grep -v -e '^background pid' -e '^\[[0-9]*\] .*(real ')
+
+    if [ "$out" != "$expected" ]; then
+        echo "FAIL $cmd: got '$out', expected '$expected'"
+        failed=1
+    else
+        echo "ok   $cmd"
+    fi
+}
+
+# '&' ends a list element, the commands after it run right away
+check "started" "sleep 0.1 & echo started"
+check "[1] Running  sleep 1 &" "sleep 1 & jobs"
+check "exit value 1" "/bin/true & /bin/false; status"
+check "b" "echo a & echo b"
+
+# built-ins set the status '&&' and '||' check
+check "/nonexistent - no such file or directory.
+failed" "cd /nonexistent && echo ran || echo failed"
+check "ran" "cd / && echo ran"
+check "exit value 1
+exit value 1" "false; status; status"
+check "fg: current: no such job
+no" "fg && echo yes || echo no"
+check "exit: x: numeric argument required
+on" "exit x; echo on"
+check "exit value 3" "/bin/sh -c 'exit 3' && echo no; status"
+
+# utilities run in the child of a pipeline stage instead of a program of the same name
+check "got hi" "echo hi | parallel echo got 2> /dev/null"
+check "[1] Running  sleep 1 &" "sleep 1 & jobs | cat"
+check "exit value 1" "test -f /nonexistent | cat; test -f /nonexistent | /bin/true | test 1 = 2; status"
+
+exit $failed
@@ -0,0 +1,104 @@
+/*
+Parser micro-benchmark: lexes, initializes, and expands Commands from a corpus of realistic and worst-case lines.
+
+Compiling
+    gcc -o parse_bench bench/parse_bench.c commands.c spawn.c cmdhash.c relay.c jobs.c arena.c lexer.c utilities.c parallel.c stats.c vars.c pathglob.c trace.c reader.c server.c -I. -std=c11 -Wall -Werror -O2
+
+Running
+    ./parse_bench [iterations]
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "commands.h"
+#include "vars.h"
+
+#define LINE_SIZE (200 * 1024 + 1)
+
+double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void fill_repeated(char* line, char* word, int max_chars) {
+    // Fills line with copies of word up to max_chars characters
+    int len = strlen(word);
+    int used = 0;
+
+    while (used + len <= max_chars) {
+        memcpy(line + used, word, len);
+        used += len;
+    }
+    line[used] = '\0';
+}
+
+void run_case(char* name, char* line, int iterations) {
+    // Parses line iterations times and prints the time per line
+    Arena arena = {NULL};
+    Token* tokens;
+    static char buffer[LINE_SIZE];
+    size_t len = strlen(line);
+    int valid = 0;
+    int i;
+
+    double start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        // the lexer unquotes in place, every iteration starts from a fresh copy as a new line would
+        memcpy(buffer, line, len + 1);
+        int num_tokens = lex_line(buffer, &tokens, &arena);
+        Command* cmd = num_tokens > 0 ? parse_tokens(tokens, num_tokens, &arena) : NULL;
+        if (cmd) {
+            expand_command(cmd, &arena);
+            valid++;
+        }
+        arena_reset(&arena);
+    }
+    double ns_per_line = (now_ns() - start) / iterations;
+
+    printf("%s,%zu,%.0f,%.1f,%d\n", name, len, ns_per_line, len / ns_per_line * 1e3, valid == iterations);
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 100000;
+    static char line[LINE_SIZE];
+
+    // the variables the lines expand
+    vars_init(getpid());
+    set_var("DIR", 3, "/var/backup", 1);
+
+    printf("case,chars,ns_per_line,mb_per_s,valid\n");
+
+    run_case("simple", "ls -la /tmp", iterations);
+    run_case("redirect", "sort -k2 -n < input.txt > sorted.txt", iterations);
+    run_case("pipeline", "grep -n error log.txt | sort | uniq -c | sort -rn", iterations);
+    run_case("quoted", "echo 'single quoted' \"double $$ quoted\" escaped\\ space", iterations);
+    run_case("background", "cp data$$.tmp /var/backup/data$$.bak &", iterations);
+    run_case("variables", "LC_ALL=C cp \"$HOME/data.tmp\" ${DIR}/data.bak ${OUT:-/tmp/out}", iterations);
+
+    // 2048 characters of short words
+    fill_repeated(line, "word ", 2048);
+    run_case("2k_chars", line, iterations / 10);
+
+    // 512 arguments
+    fill_repeated(line, "a ", 1024);
+    run_case("512_args", line, iterations / 10);
+
+    // 100k arguments
+    fill_repeated(line, "a ", 200 * 1024);
+    run_case("100k_args", line, iterations / 1000 + 1);
+
+    // 2048 characters of $$
+    fill_repeated(line, "$$", 2048);
+    run_case("dense_pid", line, iterations / 10);
+
+    // 2048 characters of words with $$
+    fill_repeated(line, "x$$y ", 2048);
+    run_case("dense_pid_words", line, iterations / 10);
+
+    return 0;
+}
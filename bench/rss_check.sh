@@ -0,0 +1,38 @@
+#!/bin/bash
+# Feeds smallsh a long stream of commands and checks that its memory stays flat.
+#
+# Usage: bench/rss_check.sh [path/to/smallsh] [num_commands]
+#
+# The stream is built-in commands with many arguments and dense $$ expansion, so the whole parse path runs
+# without forking. The shell's resident set size is sampled after the first 1% of the stream and again at the
+# end with "grep VmRSS /proc/$$/status"; the check fails if it grew by more than SLACK_KB.
+
+SMALLSH=${1:-./smallsh}
+NUM_COMMANDS=${2:-1000000}
+SLACK_KB=${SLACK_KB:-512}
+
+line='cd . $$ a$$b $$$$ x y z $$-$$ arg arg arg arg arg arg arg arg arg arg arg arg arg arg'
+
+rss=$(awk -v n="$NUM_COMMANDS" -v line="$line" 'BEGIN {
+        for (i = 1; i <= n; i++) {
+            print line
+            if (i == int(n / 100)) print "grep VmRSS /proc/$$/status"
+        }
+        print "grep VmRSS /proc/$$/status"
+        print "exit"
+    }' | "$SMALLSH" | grep -o 'VmRSS:[[:space:]]*[0-9]*' | grep -o '[0-9]*$')
+
+first=$(echo "$rss" | head -1)
+last=$(echo "$rss" | tail -1)
+
+if [ -z "$first" ] || [ -z "$last" ]; then
+    echo "rss_check: could not read VmRSS from $SMALLSH"
+    exit 1
+fi
+
+echo "rss_check: $NUM_COMMANDS commands, VmRSS ${first} kB after 1%, ${last} kB at the end"
+if [ $((last - first)) -gt "$SLACK_KB" ]; then
+    echo "rss_check: FAILED, memory grew by $((last - first)) kB"
+    exit 1
+fi
+echo "rss_check: OK"
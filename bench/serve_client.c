@@ -0,0 +1,195 @@
+/*
+Client of smallsh --serve: sends command lines to a session and writes back their output, for tests and benchmarks.
+
+The lines are the commands given with -c, or stdin until its end, which ends the session. The output of the session
+is copied to stdout without its status records, -v prints the status of every command line to stderr as well.
+The client exits with the exit status of the session, the last record it sent.
+
+Compiling
+    gcc -o serve_client bench/serve_client.c -std=c11 -Wall -Werror -O2
+
+Running
+    ./serve_client [-v] socket [-c commands]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BUFFER_SIZE (64 * 1024)
+
+typedef struct Records {
+    int in_record;              // 1 == between the NUL starting a record and its newline
+    int value;                  // status of the record being read
+    int last;                   // status of the last complete record, -1 before the first
+    int verbose;                // -v: print every status to stderr
+} Records;
+
+int connect_to(char* path) {
+    // Returns a socket connected to the server at path, or -1 with an error printed
+    struct sockaddr_un address = {0};
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "serve_client: %s: socket path too long\n", path);
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (fd == -1 || connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        perror(path);
+        return -1;
+    }
+    return fd;
+}
+
+void write_stdout(char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1) {
+            perror("write");
+            exit(1);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+void take_output(Records* records, char* data, size_t len) {
+    // Copies the output in data to stdout and takes the status records out of it
+    size_t start = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (records->in_record) {
+            if (data[i] == '\n') {
+                records->in_record = 0;
+                records->last = records->value;
+                if (records->verbose) {
+                    fprintf(stderr, "status %d\n", records->value);
+                }
+                start = i + 1;
+            }
+            else {
+                records->value = records->value * 10 + data[i] - '0';
+            }
+        }
+        else if (data[i] == '\0') {
+            write_stdout(data + start, i - start);
+            records->in_record = 1;
+            records->value = 0;
+        }
+    }
+    if (!records->in_record && start < len) {
+        write_stdout(data + start, len - start);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    static char buffer[BUFFER_SIZE];
+    static char input[BUFFER_SIZE];
+    Records records = {0, 0, -1, 0};
+    char* pending = NULL;       // commands not sent yet
+    size_t num_pending = 0;
+    int input_open = 1;         // 1 == more commands may come from stdin
+    int arg = 1;
+
+    if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+        records.verbose = 1;
+        arg++;
+    }
+    if (arg + 1 == argc - 2 && strcmp(argv[arg + 1], "-c") == 0) {
+        // -c: the whole session is the commands given, the terminator of the argument becomes their newline
+        pending = argv[arg + 2];
+        num_pending = strlen(pending);
+        pending[num_pending++] = '\n';
+        input_open = 0;
+    }
+    else if (arg + 1 != argc) {
+        fprintf(stderr, "usage: serve_client [-v] socket [-c commands]\n");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd = connect_to(argv[arg]);
+    if (fd == -1) {
+        return 1;
+    }
+
+    /*
+    The session stops reading commands while its output isn't read, so the commands are only written when the
+    socket has room, and the output is read in between. Once all of them are sent the write side is shut down,
+    which ends the session after the last one.
+    */
+    while (1) {
+        struct pollfd poll_fds[2] = {{fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        int num_fds = 1;
+
+        if (num_pending > 0) {
+            poll_fds[0].events |= POLLOUT;
+        }
+        else if (input_open) {
+            num_fds = 2;
+        }
+        if (poll(poll_fds, num_fds, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return 1;
+        }
+
+        if (num_fds == 2 && poll_fds[1].revents) {
+            ssize_t n = read(STDIN_FILENO, input, BUFFER_SIZE);
+            if (n > 0) {
+                pending = input;
+                num_pending = n;
+            }
+            else if (n == 0 || errno != EINTR) {
+                input_open = 0;
+                shutdown(fd, SHUT_WR);
+            }
+        }
+        if (poll_fds[0].revents & POLLOUT) {
+            ssize_t n = send(fd, pending, num_pending, MSG_DONTWAIT);
+            if (n > 0) {
+                pending += n;
+                num_pending -= n;
+                if (num_pending == 0 && !input_open) {
+                    shutdown(fd, SHUT_WR);
+                }
+            }
+            else if (errno != EAGAIN && errno != EINTR) {
+                // the session is gone, what it wrote is still read below
+                num_pending = 0;
+                input_open = 0;
+            }
+        }
+        if (poll_fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, buffer, BUFFER_SIZE);
+            if (n == -1 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            take_output(&records, buffer, n);
+        }
+    }
+
+    // a session that ended without a last record was killed
+    if (records.last == -1 || records.in_record) {
+        fprintf(stderr, "serve_client: session ended without a status\n");
+        return 1;
+    }
+    return records.last;
+}
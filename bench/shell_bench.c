@@ -0,0 +1,222 @@
+/*
+Shell throughput and latency benchmark: runs smallsh on generated workloads through pipes, one line at a time,
+and reports commands per second, p50 and p99 latency, and the shell's peak RSS for each workload.
+
+A line's latency is the time from writing it after the ": " prompt until the next prompt arrives, so it covers
+reading, parsing, expanding and running the command: get_command and run_external_command for every line.
+The shell's peak RSS is VmHWM from /proc/<pid>/status, read once every line has run, before exit.
+
+Workloads
+    echo            built-in echo of a short line
+    args_pid        built-in echo of 256 arguments with dense $$ expansion, to /dev/null
+    background      bursts of /bin/true &, reaped before later prompts
+    redirect        /bin/true with input, output, append, and duplicated descriptors redirected
+
+Compiling
+    gcc -o shell_bench bench/shell_bench.c -std=c11 -Wall -Werror -O2
+
+Running
+    ./shell_bench [path/to/smallsh] [commands]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define OUTPUT_SIZE (64 * 1024)
+
+typedef struct Shell {
+    pid_t pid;
+    int input_fd;               // write end of the shell's stdin
+    int output_fd;              // read end of the shell's stdout
+} Shell;
+
+double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void start_shell(Shell* shell, char* path) {
+    // Starts the shell at path with pipes for stdin and stdout, stderr goes to /dev/null
+    int input[2];
+    int output[2];
+
+    if (pipe2(input, O_CLOEXEC) == -1 || pipe2(output, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        exit(1);
+    }
+    shell->pid = fork();
+    if (shell->pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (shell->pid == 0) {
+        dup2(input[0], STDIN_FILENO);
+        dup2(output[1], STDOUT_FILENO);
+        freopen("/dev/null", "w", stderr);
+        execl(path, path, (char*)NULL);
+        perror(path);
+        _exit(127);
+    }
+    close(input[0]);
+    close(output[1]);
+    shell->input_fd = input[1];
+    shell->output_fd = output[0];
+}
+
+int wait_for_prompt(Shell* shell) {
+    /*
+    Reads the shell's output until it ends with the ": " prompt.
+    Returns 0 once the prompt arrived, or -1 if the shell closed its output.
+    */
+    static char output[OUTPUT_SIZE];
+    int used = 0;
+
+    while (1) {
+        ssize_t n = read(shell->output_fd, output + used, OUTPUT_SIZE - used);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        used += n;
+        if (used >= 2 && output[used - 2] == ':' && output[used - 1] == ' ') {
+            return 0;
+        }
+        // only the end of the output matters, keep its last character
+        if (used == OUTPUT_SIZE) {
+            output[0] = output[used - 1];
+            used = 1;
+        }
+    }
+}
+
+void send_line(Shell* shell, char* line) {
+    size_t len = strlen(line);
+    if (write(shell->input_fd, line, len) != (ssize_t)len) {
+        perror("write");
+        exit(1);
+    }
+}
+
+long peak_rss_kb(pid_t pid) {
+    // Returns VmHWM of pid in kB, or -1 if it can't be read
+    char path[64];
+    char line[256];
+    long kb = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    FILE* status = fopen(path, "r");
+    if (status == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), status)) {
+        if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return kb;
+}
+
+void run_workload(char* name, char* smallsh, char** lines, int num_lines, int commands) {
+    /*
+    Runs commands lines through a new shell, cycling through lines, and prints one CSV row for the workload.
+    */
+    Shell shell;
+    double* latencies = malloc(commands * sizeof(double));
+    int status;
+    int i;
+
+    start_shell(&shell, smallsh);
+    if (wait_for_prompt(&shell) == -1) {
+        fprintf(stderr, "%s: no prompt from %s\n", name, smallsh);
+        exit(1);
+    }
+
+    double start = now_us();
+    for (i = 0; i < commands; i++) {
+        double sent = now_us();
+        send_line(&shell, lines[i % num_lines]);
+        if (wait_for_prompt(&shell) == -1) {
+            fprintf(stderr, "%s: shell exited after %d commands\n", name, i);
+            exit(1);
+        }
+        latencies[i] = now_us() - sent;
+    }
+    double elapsed = now_us() - start;
+    long rss_kb = peak_rss_kb(shell.pid);
+
+    send_line(&shell, "exit\n");
+    close(shell.input_fd);
+    while (wait_for_prompt(&shell) != -1) {
+        ;
+    }
+    close(shell.output_fd);
+    waitpid(shell.pid, &status, 0);
+
+    qsort(latencies, commands, sizeof(double), compare_doubles);
+    printf("%s,%d,%.0f,%.1f,%.1f,%ld\n", name, commands, commands / (elapsed / 1e6),
+           latencies[commands / 2], latencies[(int)(commands * 0.99)], rss_kb);
+    fflush(stdout);
+    free(latencies);
+}
+
+int main(int argc, char* argv[]) {
+    char* smallsh = argc > 1 ? argv[1] : "./smallsh";
+    int commands = argc > 2 ? atoi(argv[2]) : 20000;
+    char dir[] = "/tmp/shell_benchXXXXXX";
+    static char args_line[4096];
+    char redirect_line[512];
+    int used = 0;
+    int i;
+
+    if (commands < 1 || mkdtemp(dir) == NULL) {
+        fprintf(stderr, "usage: shell_bench [path/to/smallsh] [commands]\n");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // 256 arguments, most of them expanding $$
+    used += sprintf(args_line, "echo");
+    for (i = 0; i < 256; i++) {
+        used += sprintf(args_line + used, i % 4 ? " a$$b" : " $$$$");
+    }
+    sprintf(args_line + used, " > /dev/null\n");
+
+    sprintf(redirect_line, "/bin/true < /dev/null > %s/out 2>> %s/err 3> %s/three 4>&1 5<&0\n", dir, dir, dir);
+
+    char* echo_lines[] = {"echo a line of the workload\n"};
+    char* args_lines[] = {args_line};
+    char* background_lines[] = {"/bin/true &\n", "/bin/true &\n", "/bin/true &\n", "/bin/true &\n", "echo burst\n"};
+    char* redirect_lines[] = {redirect_line};
+
+    printf("workload,commands,commands_per_s,p50_us,p99_us,peak_rss_kb\n");
+    run_workload("echo", smallsh, echo_lines, 1, commands);
+    run_workload("args_pid", smallsh, args_lines, 1, commands);
+    run_workload("background", smallsh, background_lines, 5, commands);
+    run_workload("redirect", smallsh, redirect_lines, 1, commands / 4 + 1);
+
+    char* names[] = {"out", "err", "three"};
+    for (i = 0; i < 3; i++) {
+        sprintf(redirect_line, "%s/%s", dir, names[i]);
+        unlink(redirect_line);
+    }
+    rmdir(dir);
+    return 0;
+}
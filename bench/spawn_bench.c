@@ -0,0 +1,80 @@
+/*
+Compares spawn latency of the clone(CLONE_VM | CLONE_VFORK) engine against fork() as the shell's RSS grows.
+
+Compiling
+    gcc -o spawn_bench bench/spawn_bench.c spawn.c relay.c stats.c -I. -std=c11 -Wall -Werror -O2
+
+Running
+    ./spawn_bench [iterations] [rss_mb ...]
+*/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "commands.h"
+#include "spawn.h"
+
+double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+double time_spawns(Command* cmd, int mode, int iterations) {
+    // Returns the mean latency in microseconds of spawning and reaping cmd
+    int status;
+    int i;
+
+    spawn_mode = mode;
+    double start = now_us();
+    for (i = 0; i < iterations; i++) {
+        pid_t pid = spawn_command(cmd, -1, -1, -1);
+        if (pid == -1) {
+            perror("spawn_command");
+            exit(1);
+        }
+        waitpid(pid, &status, 0);
+    }
+    return (now_us() - start) / iterations;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    int default_sizes[] = {0, 64, 256, 1024};
+    int num_sizes = argc > 2 ? argc - 2 : 4;
+
+    // foreground /bin/true with no redirections
+    char* args[] = {"true", NULL};
+    Command cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.command = "true";
+    cmd.args = args;
+
+    char* ballast = NULL;
+    int i;
+
+    printf("rss_mb,vfork_us,fork_us\n");
+    for (i = 0; i < num_sizes; i++) {
+        int size_mb = argc > 2 ? atoi(argv[i + 2]) : default_sizes[i];
+
+        // grow and touch the heap so every page is resident
+        ballast = realloc(ballast, (size_t)size_mb * 1024 * 1024 + 1);
+        if (ballast == NULL) {
+            perror("realloc");
+            return 1;
+        }
+        memset(ballast, 1, (size_t)size_mb * 1024 * 1024 + 1);
+
+        double vfork_us = time_spawns(&cmd, SPAWN_VFORK, iterations);
+        double fork_us = time_spawns(&cmd, SPAWN_FORK, iterations);
+        printf("%d,%.1f,%.1f\n", size_mb, vfork_us, fork_us);
+        fflush(stdout);
+    }
+
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Runs smallsh on inputs past the limits it used to have: a line with many arguments and many concurrent
+# background processes.
+#
+# Usage: bench/stress.sh [path/to/smallsh] [num_args] [num_jobs]
+#
+# The argument line is given to the status-free built-in "cd", which ignores extra arguments, and to the external
+# command "echo", whose output is counted. The background processes are "sleep" commands that all outlive the
+# last launch, so every one of them is in the job table at once; the shell is then asked to exit, which
+# terminates them.
+
+SMALLSH=${1:-./smallsh}
+NUM_ARGS=${2:-100000}
+NUM_JOBS=${3:-10000}
+SLEEP_SECONDS=${SLEEP_SECONDS:-30}
+
+fail() {
+    echo "stress: $1"
+    exit 1
+}
+
+# one line of NUM_ARGS arguments, run as a built-in and as an external command
+args=$(awk -v n="$NUM_ARGS" 'BEGIN { for (i = 1; i <= n; i++) printf " a%d", i }')
+out=$(printf 'cd .%s\necho%s | wc -w\nexit\n' "$args" "$args" | "$SMALLSH" | sed -n 's/^[: ]*\([0-9][0-9]*\)$/\1/p')
+[ "$out" = "$NUM_ARGS" ] || fail "expected $NUM_ARGS words from echo, got '$out'"
+echo "stress: $NUM_ARGS-argument line ok"
+
+# NUM_JOBS background processes alive together
+start=$(date +%s%N)
+out=$(awk -v n="$NUM_JOBS" -v s="$SLEEP_SECONDS" 'BEGIN {
+        for (i = 1; i <= n; i++) print "sleep " s " &"
+        print "exit"
+    }' | "$SMALLSH" | grep -c 'background pid is')
+end=$(date +%s%N)
+[ "$out" = "$NUM_JOBS" ] || fail "expected $NUM_JOBS background processes, started $out"
+echo "stress: $NUM_JOBS background processes ok ($(( (end - start) / 1000000 )) ms)"
@@ -0,0 +1,53 @@
+#!/bin/bash
+# Checks that running a command costs the shell no more system calls than its budget.
+#
+# Usage: bench/syscall_budget.sh [path/to/smallsh]
+#
+# Every case runs under smallsh --stats, which counts the calls the shell itself makes on the launch path and
+# prints them after the command. stdin is not a terminal here; on a terminal a foreground job adds two
+# tcsetpgrp calls to hand the terminal over and take it back.
+
+SMALLSH=${1:-./smallsh}
+failed=0
+
+check() {
+    # check budget command: runs command and compares the shell's system calls with budget
+    local budget=$1
+    local cmd=$2
+    local stats=$("$SMALLSH" --stats -c "$cmd" 2>&1 >/dev/null | grep '^stats:' | tail -1)
+    local count=$(echo "$stats" | sed -n 's/^stats: \([0-9]*\) syscalls.*/\1/p')
+
+    if [ -z "$count" ] || [ "$count" -gt "$budget" ]; then
+        echo "FAIL $cmd: ${count:-?} > $budget syscalls (${stats#*:})"
+        failed=1
+    else
+        echo "ok   $cmd: $count <= $budget syscalls"
+    fi
+}
+
+# spawn: sigprocmask x2, clone, setpgid; then wait4
+check 5 "/bin/true"
+# a command found in PATH: access() checks that its remembered path is still executable
+check 6 $'hash sleep\nsleep 0'
+check 5 "/bin/true > /dev/null"
+check 5 "/bin/true > /dev/null 2>&1"
+check 4 "/bin/true &"
+# here-string: memfd_create, pwrite, and the shell's close of the memfd
+check 8 "/bin/cat <<< hi"
+# per extra stage: pipe2, two closes, spawn, wait4
+check 13 "/bin/true | /bin/true"
+check 21 "/bin/true | /bin/true | /bin/true"
+# in-process utilities: getrusage before and after, the output write, plus saving and restoring stdout for a
+# redirection
+check 3 "echo hi"
+check 9 "echo hi > /dev/null"
+# every further descriptor redirected: saving it, the redirection, and restoring it
+check 13 "echo hi > /dev/null 2>&1"
+# other built-ins aren't measured unless timed
+check 1 "cd ."
+# command substitution: memfd_create, saving, redirecting, and restoring stdout, fstat, the read, two closes,
+# and the getrusage pairs of pwd and echo
+check 14 'echo $(pwd)'
+check 15 'echo $(/bin/true)'
+
+exit $failed
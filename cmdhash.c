@@ -0,0 +1,248 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cmdhash.h"
+#include "stats.h"
+
+#define INITIAL_BUCKETS 64          // buckets allocated on first insert, doubled whenever entries outnumber them
+
+typedef struct HashEntry {
+    char* name;                     // command name as typed
+    char* path;                     // absolute path found in PATH
+    unsigned long hits;             // number of times the path was used
+    struct HashEntry* next;         // next entry in the same bucket
+} HashEntry;
+
+HashEntry** buckets = NULL;         // command name -> path table
+int num_buckets = 0;
+int num_entries = 0;
+char* hashed_path_var = NULL;       // value of PATH the table was built from
+
+unsigned long hash_name(char* name) {
+    // FNV-1a hash of a command name
+    unsigned long hash = 14695981039346656037UL;
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 1099511628211UL;
+    }
+    return hash;
+}
+
+void hash_clear() {
+    /*
+    Forgets every remembered command path.
+    */
+    int i;
+    HashEntry* entry;
+    HashEntry* next;
+
+    for (i = 0; i < num_buckets; i++) {
+        for (entry = buckets[i]; entry != NULL; entry = next) {
+            next = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+        }
+        buckets[i] = NULL;
+    }
+    num_entries = 0;
+}
+
+void check_path_changed() {
+    // Clear the table when PATH no longer matches the value the paths were resolved against
+    char* path_var = getenv("PATH");
+
+    if (hashed_path_var && path_var && strcmp(hashed_path_var, path_var) == 0) {
+        return;
+    }
+    if (!hashed_path_var && !path_var) {
+        return;
+    }
+
+    hash_clear();
+    free(hashed_path_var);
+    hashed_path_var = path_var ? strdup(path_var) : NULL;
+}
+
+int is_executable(char* path) {
+    // Returns 1 if path is a regular file the shell may execute, otherwise returns 0
+    struct stat info;
+    return COUNTED(SYSCALL_STAT, stat(path, &info)) == 0 && S_ISREG(info.st_mode)
+           && COUNTED(SYSCALL_ACCESS, access(path, X_OK)) == 0;
+}
+
+char* search_path(char* name) {
+    /*
+    Walks every PATH entry looking for an executable called name.
+    Returns a newly allocated absolute path, or NULL if not found.
+    */
+    char* path_var = getenv("PATH");
+    if (path_var == NULL) {
+        return NULL;
+    }
+
+    size_t name_len = strlen(name);
+    char* dir = path_var;
+
+    while (1) {
+        char* end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+
+        // an empty PATH entry means the current directory
+        char* candidate = malloc(dir_len + name_len + 3);
+        if (dir_len == 0) {
+            sprintf(candidate, "./%s", name);
+        }
+        else {
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            strcpy(candidate + dir_len + 1, name);
+        }
+
+        if (is_executable(candidate)) {
+            return candidate;
+        }
+        free(candidate);
+
+        if (end == NULL) {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+void grow_buckets() {
+    // Doubles the number of buckets and rehashes every entry
+    int new_num_buckets = num_buckets ? num_buckets * 2 : INITIAL_BUCKETS;
+    HashEntry** new_buckets = calloc(new_num_buckets, sizeof(HashEntry*));
+    int i;
+    HashEntry* entry;
+    HashEntry* next;
+
+    for (i = 0; i < num_buckets; i++) {
+        for (entry = buckets[i]; entry != NULL; entry = next) {
+            next = entry->next;
+            unsigned long index = hash_name(entry->name) % new_num_buckets;
+            entry->next = new_buckets[index];
+            new_buckets[index] = entry;
+        }
+    }
+
+    free(buckets);
+    buckets = new_buckets;
+    num_buckets = new_num_buckets;
+}
+
+HashEntry* find_entry(char* name, HashEntry*** link) {
+    // Finds the entry for name, link is set to the pointer that refers to it
+    HashEntry** current = &buckets[hash_name(name) % num_buckets];
+
+    while (*current != NULL && strcmp((*current)->name, name) != 0) {
+        current = &(*current)->next;
+    }
+    *link = current;
+    return *current;
+}
+
+HashEntry* resolve(char* name) {
+    /*
+    Returns the entry for name, searching PATH when it isn't remembered or its file no longer exists.
+    Returns NULL if the command can't be found.
+    */
+    check_path_changed();
+    if (num_entries >= num_buckets) {
+        grow_buckets();
+    }
+
+    HashEntry** link;
+    HashEntry* entry = find_entry(name, &link);
+
+    // remembered path still exists
+    if (entry && COUNTED(SYSCALL_ACCESS, access(entry->path, X_OK)) == 0) {
+        return entry;
+    }
+
+    char* path = search_path(name);
+
+    // command vanished or was never found, drop any stale entry
+    if (path == NULL) {
+        if (entry) {
+            *link = entry->next;
+            free(entry->name);
+            free(entry->path);
+            free(entry);
+            num_entries--;
+        }
+        return NULL;
+    }
+
+    // command moved, keep the hit count
+    if (entry) {
+        free(entry->path);
+        entry->path = path;
+        return entry;
+    }
+
+    entry = malloc(sizeof(HashEntry));
+    entry->name = strdup(name);
+    entry->path = path;
+    entry->hits = 0;
+    entry->next = *link;
+    *link = entry;
+    num_entries++;
+    return entry;
+}
+
+char* hash_lookup(char* name) {
+    /*
+    Returns the absolute path to run for the command name and counts a hit.
+    Names containing a '/' are used as given. Returns NULL if the command isn't found in PATH.
+    */
+    if (strchr(name, '/')) {
+        return name;
+    }
+
+    HashEntry* entry = resolve(name);
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->hits++;
+    return entry->path;
+}
+
+int hash_add(char* name) {
+    /*
+    Resolves name and remembers its path without counting a hit.
+    Returns 1 if found, otherwise returns 0.
+    */
+    if (strchr(name, '/')) {
+        return 1;
+    }
+    return resolve(name) != NULL;
+}
+
+void hash_print() {
+    /*
+    Prints every remembered command with the number of times it was used.
+    */
+    int i;
+    HashEntry* entry;
+
+    check_path_changed();
+    if (num_entries == 0) {
+        printf("hash table empty\n");
+        fflush(stdout);
+        return;
+    }
+
+    printf("hits\tcommand\n");
+    for (i = 0; i < num_buckets; i++) {
+        for (entry = buckets[i]; entry != NULL; entry = entry->next) {
+            printf("%4lu\t%s\n", entry->hits, entry->path);
+        }
+    }
+    fflush(stdout);
+}
@@ -0,0 +1,9 @@
+#ifndef CMDHASH_H
+#define CMDHASH_H
+
+char* hash_lookup(char* name);
+int hash_add(char* name);
+void hash_clear();
+void hash_print();
+
+#endif
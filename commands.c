@@ -1,616 +1,1532 @@
-#define _POSIX_C_SOURCE 200809L
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/wait.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <fcntl.h>
-#include <math.h>
-#include "commands.h"
-
-#define MAX_INPUT_CHARS 2048        // maximum characters one can input in one line
-#define MAX_INPUT_BUF_SIZE 2050     // 
-#define MAX_ARGS 512
-
-int* copy_fg_mode; 
-
-int count_vars_to_expand(char* argument) {
-    // Count the number of times '$$' occurs in an argument
-    int num_vars = 0;
-    int i;
-
-    for (i = 0; i < strlen(argument); i++){
-        // only count occurences of '$$'
-        if (argument[i] == '$' && (argument[i+1] && argument[i+1] == '$')) {
-            num_vars++;
-            i++;
-        }
-    }
-    return num_vars;
-}
-
-char* pid_to_string(pid_t pid) {
-    // Convert the process ID to a string
-    char* pid_buffer;         
-    int pid_buf_size = (int)(ceil(log10(pid))+1);           // calculates number of digits in pid, source: https://stackoverflow.com/a/8257728
-    pid_buffer = malloc(pid_buf_size);
-
-    sprintf(pid_buffer, "%d", pid);                         // send pid as string to buffer
-    
-    return pid_buffer;
-}
-
-char* expand_variable(char* argument, int num_vars, pid_t pid) {
-    // Variable expansion of '$$' to process ID
-    // Returns new argument
-
-    char* pid_string = pid_to_string(pid);            // pid as a string
-    
-    // argument with expanded variables
-    char* new_arg;
-    int new_arg_size = ((strlen(pid_string) * num_vars) + ((strlen(argument)+1) - (num_vars * 2)));         // new length of argument
-    new_arg = calloc(new_arg_size, sizeof(char));
-    
-    int i;
-    int j = 0;
-
-    // build new argument string
-    for (i = 0; i < strlen(argument); i++) {
-        // variable to expand
-        if (argument[i] == '$' && (argument[i+1] && argument[i+1] == '$')) {
-            strcat(new_arg, pid_string);    // concatenate pid to argument
-            j += strlen(pid_string);
-            i++;
-        }
-        // normal letter
-        else {
-            new_arg[j++] = argument[i];     // add letter
-        }
-    }
-
-    return new_arg;
-}
-
-int tokenize_input(char commandInput[], char* arguments[], pid_t shell_pid) {
-    // Tokenizes input by spaces into separate arguments
-    // Returns number of tokens
-
-    char* saveptr;              // tracks position in string
-    int token_count = 0;        
-    char* token = strtok_r(commandInput, " ", &saveptr);
-    
-    int num_vars_to_expand;     // number of variables to expand per token
-
-    while(token != NULL) {
-        // expand all variables found in token
-        num_vars_to_expand = count_vars_to_expand(token);
-        if (num_vars_to_expand) {
-            token = expand_variable(token, num_vars_to_expand, shell_pid);
-        }
-
-        // add token to list of arguments
-        arguments[token_count] = strdup(token);
-        token_count++;
-        token = strtok_r(NULL, " ", &saveptr);
-    }
-
-    return token_count;
-}
-
-int check_input_validity(char* arguments[], int arg_count) {
-    // Checks if the arguments provided come before any file redirection
-    // Returns 1 if they do, otherwise returns 0
-
-    int i; 
-
-    for (i = 0; i < arg_count; i++) {
-        // midline comment encountered
-        if (strcmp(arguments[i], "//") == 0) {
-            return 0;
-        }
-        // check when a redirect is encountered
-        if ((strcmp(arguments[i], "<") == 0) || (strcmp(arguments[i], ">")) == 0) {
-            // check if there's another argument after the filename
-            if (arguments[i+2]) {
-                // next argument is another redirect or an '&' symbol at the end of the arguments
-                if ((strcmp(arguments[i+2], "<") == 0) || (strcmp(arguments[i+2], ">") == 0) || (strcmp(arguments[i+2], "&") == 0 && (i+2 == arg_count - 1))) {
-                    return 1;
-                }
-                // next argument is invalid
-                else {
-                    return 0;
-                }
-            }
-            return 1;
-        }
-    }
-    return 1;
-}
-
-void init_command(Command* cmd, char* arguments[], int arg_count) {
-    /*
-    Initializes the Command struct with the arguments provided.
-    */
-   
-    // initialize all struct data members to null
-    int i;
-    for (i = 0; i < MAX_ARGS; i++) {
-        cmd->args[i] = NULL;
-    }
-    cmd->command = NULL;
-    cmd->input_file = NULL;         
-    cmd->output_file = NULL;
-    cmd->is_bg = 0;
-    
-    int j = 0;
-    // flags for readability
-    int redirecting_in;
-    int redirecting_out;
-    int run_in_bg;
-
-    // go through provided arguments and initialize Command struct
-    for (i = 0; i < arg_count; i++) {
-        redirecting_in = strcmp(arguments[i], "<") == 0 ? 1 : 0;        // redirect in encountered: 1 == True, 0 == False
-        redirecting_out = strcmp(arguments[i], ">") == 0 ? 1 : 0;       // redirect out encountered: 1 == True, 0 == False
-        run_in_bg = strcmp(arguments[i], "&") == 0 ? 1 : 0;             // bg operator encountered: 1 == True, 0 == False
-
-        // first argument is the command
-        if (i == 0) {
-            cmd->command = strdup(arguments[i]);
-        }
-        // input file provided
-        if (redirecting_in) {
-            cmd->input_file = strdup(arguments[i+1]);
-            i++;
-        }
-        // output file provided
-        else if (redirecting_out) {
-            cmd->output_file = strdup(arguments[i+1]);
-            i++;
-        }
-        // run in background provided
-        else if (run_in_bg) {
-            cmd->is_bg = 1;
-        }
-        // regular argument
-        else {
-            cmd->args[j] = strdup(arguments[i]);
-            j++;
-        }
-    }
-}
-
-Command get_command(pid_t shell_pid) {
-    /*
-    Prompts the user for commands and initializes a Command struct.
-    Returns: Command struct.
-    */
-
-    // command struct
-    Command cmd;
-
-    // arguments array
-    char* arguments[512];
-    
-    // input buffer
-    char* input = NULL;
-    size_t input_len = 0;
-    
-    // flags for readability
-    int num_chars;
-    int input_exceeds_max_chars;
-    int blank_line_provided;
-    int comment_line_provided;
-    int valid_input;
-    int num_tokens;
-
-    //Prompt user and read input until a valid input is provided
-    do {
-        printf(": ");
-        fflush(stdout);
-        getline(&input, &input_len, stdin);
-
-        // number of characters
-        num_chars = strlen(input) - 1;
-
-        // replace newline character from input
-        input[num_chars] = '\0';
-
-        // initialize flags
-        input_exceeds_max_chars = num_chars > MAX_INPUT_CHARS;
-        blank_line_provided = num_chars < 1;
-        comment_line_provided = input[0] == '#';
-
-        // Display message when exceeding allowable characters
-        if (input_exceeds_max_chars) {
-            printf("You entered %d characters which exceeds the maximum of 2048 characters. Please try again.\n", num_chars);
-            fflush(stdout);
-        }
-
-        // Don't tokenize the input if blank, is a comment, or exceeds max chars
-        if (blank_line_provided || comment_line_provided || input_exceeds_max_chars) {
-            valid_input = 0;
-        }
-        // Tokenize input and check if valid
-        else {
-            num_tokens = tokenize_input(input, arguments, shell_pid);
-            valid_input = check_input_validity(arguments, num_tokens);
-        }
-    } while (!valid_input);
-
-    // input validated, initialize Command struct
-    init_command(&cmd, arguments, num_tokens);
-    
-    free(input);
-    return cmd;
-}
-
-char *safe(char *s) {
-    // Safely print null strings
-    return s ? s : "NULL";
-}
-
-void display_command(Command* cmd) {
-    printf("command: %s\n", safe(cmd->command));
-    fflush(stdout);
-
-    int i = 0;
-    char* arg;
-    while ((arg = cmd->args[i]) != NULL) {
-        printf("arg[%d]: %s\n", i, safe(arg));
-        fflush(stdout);
-        i++;
-    }
-
-    printf("input file: %s\n", safe(cmd->input_file));
-    fflush(stdout);
-    printf("output file: %s\n", safe(cmd->output_file));
-    fflush(stdout);
-    printf("is_bg: %d\n", cmd->is_bg);
-    fflush(stdout);
-};
-
-int built_in_command(Command* cmd) {
-    /*
-    Checks if the command provided is a built-in command
-    Returns 1 if built-in, otherwise return 0
-    */
-
-    char* built_ins[] = {"exit", "cd", "status"};           // list of built-in commands available
-    int num_built_ins = sizeof(built_ins) / sizeof(built_ins[0]);
-    int i;
-
-    // iterate list of allowable built-ins
-    for (i = 0; i < num_built_ins; i++) {
-        // command is built-in
-        if (strcmp(cmd->command, built_ins[i]) == 0) {
-            return 1;
-        }
-    }
-    // command given is not built-in
-    return 0;
-}
-
-void exit_cmd(int num_processes, pid_t processes[]) {
-    /*
-    Built-in exit command, exits the shell.
-    Kills all processes that have been started before terminating. 
-    */
-
-    // no processes have been started
-    if (num_processes == 0) {
-        exit(0);
-    }
-    // processes have been started, terminate all of background processes before exiting
-    else {
-        int status;
-        int i;
-        for (i = 0; i < num_processes; i++) {
-            kill(processes[i], SIGTERM);                // terminate process
-            waitpid(processes[i], &status, WNOHANG);    // remove zombie process
-        }
-        exit(0);
-    }
-}
-
-void status_cmd(int status) {
-    /*
-    Prints out the exit status or the terminating signal of the last foreground process ran by the shell.
-    Returns exit status of 0 if called before any non-built-in foreground command is run.
-    */
-    
-    // process was terminated normally, print status value
-    if (WIFEXITED(status)) {
-        printf("exit value %d\n", WEXITSTATUS(status));
-        fflush(stdout);
-    }
-    // process was terminated abnormally, print signal number that caused the termination
-    else {
-        printf("terminated by signal %d\n", WTERMSIG(status));
-        fflush(stdout);
-    }
-}
-
-void cd_cmd(Command* cmd) {
-    /*
-    Changes current directory to the directory provided, if none provided it changes to the home directory.
-    */
-    int directory_provided = cmd->args[1] ? 1 : 0;
-    
-    // directory name provided
-    if (directory_provided) {
-        // directory path is invalid, display error message
-        if (chdir(cmd->args[1]) != 0) {
-            printf("%s - no such file or directory.\n", cmd->args[1]);
-            fflush(stdout);
-        }
-        // directory path is valid, change to the directory
-        else {
-            chdir(cmd->args[1]);
-        }
-    }
-    // no directory name provided, change to home directory
-    else {
-        chdir(getenv("HOME"));
-    }
-}
-
-void run_built_in(Command* cmd, int* status, int num_processes_running, pid_t processes[]) {
-    // command given: exit
-    if (strcmp(cmd->command, "exit") == 0) {
-        exit_cmd(num_processes_running, processes);
-    }
-    // command given: cd
-    else if (strcmp(cmd->command, "cd") == 0) {
-        cd_cmd(cmd);
-    }
-    // command given: status
-    else {
-        // no commands have been ran yet
-        status_cmd(*status);
-    }
-}
-
-void remove_pid_from_processes(pid_t pid, int processes[], int* num_processes) {
-    int i;
-    int index_removed = 0;
-    for (i = 0; i < *num_processes; i++) {
-        if (processes[i] == pid) {
-            index_removed = i;
-        }  
-    }
-
-    processes[index_removed] = processes[*num_processes - 1];
-    *num_processes -= 1;
-}
-
-pid_t check_background_processes() {
-    pid_t pid;          // pid of terminated child
-    int status;         // termination status
-
-    // check if any background child process has terminated
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        printf("background pid %d is done: ", pid);
-
-        // process was terminated normally, print status value
-        if (WIFEXITED(status)) {
-            printf("exit value %d\n", WEXITSTATUS(status));
-        }
-        // process was terminated abnormally, print signal number causing termination
-        else {
-            printf("terminated by signal %d\n", WTERMSIG(status));
-        }
-        
-        fflush(stdout);
-        return pid;
-    }
-
-    return 0;
-}
-
-void open_and_redirect(int* fd, char* filename, int* status, int open_type) {
-    /*
-    Opens a file and redirects stdin or stdout according to open_type value.
-    If open_type == 0, stdin is redirected to the file.
-    If open_type == 1, stdout is redirected to the file.
-    */
-    
-    char* type = open_type == 0 ? "input" : "output";
-    
-    // open the file for reading
-    if (open_type == 0) {
-        *fd = open(filename, O_RDONLY);
-    }
-    // open the file for writing
-    else {
-        *fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
-    }
-
-    // error openning file
-    if (*fd == -1) {
-        printf("cannot open %s for %s\n", filename, type);
-        fflush(stdout);
-        *status = 1;
-        exit(1);
-    }
-    // file openned
-    else {
-        // redirect stdin or stdout to file
-        int redirect_status = dup2(*fd, open_type);
-
-        // error redirecting stdin or stdout to file
-        if (redirect_status == -1) {
-            printf("unable to redirect %s to %s\n", filename, type);
-            fflush(stdout);
-            *status = 1;
-            exit(1);
-        }
-    }
-}
-
-void handle_SIGTSTP(int signo) {
-    // currently in regular mode
-    if (*copy_fg_mode == 0) {
-        // change to foreground mode
-        *copy_fg_mode = 1;
-        write(STDOUT_FILENO, "\nEntering foreground-only mode (& is now ignored)\n", 51);
-        fflush(stdout);
-    }
-
-    // currently in foreground mode
-    else {
-        // change to regular mode
-        *copy_fg_mode = 0;
-        write(STDOUT_FILENO, "\nExiting foreground-only mode\n", 31);
-        fflush(stdout);
-    }
-    write(STDOUT_FILENO, ": ", 3);
-    fflush(stdout);
-}  
-
-void check_foreground_mode(Command* cmd) {
-    // When in foreground mode, update all commands to foreground only
-    if (*copy_fg_mode == 1) {
-        cmd->is_bg = 0;
-    } 
-}
-
-void run_external_command(Command* cmd, int* status, pid_t processes[], int* num_processes, int* foreground_mode) {
-    /*
-    Executes all external commands.
-    */
-
-    copy_fg_mode = foreground_mode;                 // global foreground_mode address
-    check_foreground_mode(cmd);
-    pid_t spawn_pid = -2;
-    int child_status;                           // child process status
-    int background_process = cmd->is_bg;        // run in background?
-    int in_fd;                                  // input file descriptor
-    int out_fd;                                 // output file descriptor
-
-    // intialize SIGINT_action struct
-    // source: Signal Handling API module
-    struct sigaction SIGINT_action = {{0}};
-    SIGINT_action.sa_handler = SIG_IGN;              // ignore SIGINT
-    sigfillset(&SIGINT_action.sa_mask);              // block all catchable signals 
-    sigaction(SIGINT, &SIGINT_action, NULL);        // install signal handler
-
-    // initialize SIGTSTP_action struct
-    struct sigaction SIGTSTP_action = {{0}};
-    SIGTSTP_action.sa_handler = handle_SIGTSTP;      // handler for SIGTSTP
-    SIGTSTP_action.sa_flags = SA_RESTART;           // restart any interrupted signal calls
-    sigfillset(&SIGTSTP_action.sa_mask);            // block all catchable signals
-    sigaction(SIGTSTP, &SIGTSTP_action, NULL);      // install signal handler
-
-
-    spawn_pid = fork();                             // fork a process
-
-    // fork failed
-    if (spawn_pid == -1) {
-        printf("fork() failed!\n");
-        fflush(stdout);
-        exit(1);
-    }
-
-    // child process
-    else if (spawn_pid == 0) {
-        int reading = 0;
-        int writing = 1;
-        
-        // ignore SIGTSTP signals
-        SIGTSTP_action.sa_handler = SIG_IGN;
-        sigaction(SIGTSTP, &SIGTSTP_action, NULL);
-
-        // background process
-        if (background_process) {
-            // input file given, redirect stdin to file
-            if (cmd->input_file) {
-                open_and_redirect(&in_fd, cmd->input_file, &child_status, reading);
-            }
-            // input file not given, redirect input to /dev/null
-            else {
-                open_and_redirect(&in_fd, "/dev/null", &child_status, reading);
-            }
-
-            // output file given, redirect stdout to file
-            if (cmd->output_file) {
-                open_and_redirect(&out_fd, cmd->output_file, &child_status, writing);
-            }
-            // output file not given, redirect stdout to /dev/null
-            else {
-                open_and_redirect(&out_fd, "/dev/null", &child_status, writing);
-            }
-        }
-
-        // foreground processes
-        else {
-            // allow process to receive SIGINT
-            SIGINT_action.sa_handler = SIG_DFL;
-            sigaction(SIGINT, &SIGINT_action, NULL);
-
-            // input file given, redirect stdin to file
-            if (cmd->input_file) {
-                open_and_redirect(&in_fd, cmd->input_file, status, reading);
-            }
-            // output file given, redirect stdout to file
-            if (cmd->output_file) {
-                open_and_redirect(&out_fd, cmd->output_file, status, writing);
-            }
-        }
-
-        close(in_fd);
-        close(out_fd);
-
-        // run command
-        execvp(cmd->command, cmd->args);
-
-        // command failed since execvp returned
-        printf("Command '%s' could not be found.\n", cmd->command);
-        fflush(stdout);
-        exit(1);
-    }
-    // parent process
-    else {
-        // Close input and output files after finished executing command
-        // source: Processes and I/O module
-        fcntl(in_fd, F_SETFD, FD_CLOEXEC);
-        fcntl(out_fd, F_SETFD, FD_CLOEXEC);
-
-        // command ran in background
-        if (background_process) {
-            waitpid(spawn_pid, &child_status, WNOHANG);     // don't wait for process to terminate, return command line access and control to user
-            
-            printf("background pid is %d\n", spawn_pid);
-            fflush(stdout);
-
-            processes[*num_processes] = spawn_pid;          // save background process child pid
-            *num_processes += 1;                            // increment number of background process
-
-        }
-        // command ran in foreground
-        else {
-            // wait for child process to terminate
-            waitpid(spawn_pid, &child_status, 0);
-        
-            // foreground process was terminated abnormally
-            if (WIFSIGNALED(child_status)) {
-                char* msg = "\nterminated by signal 2\n";
-                write(STDOUT_FILENO, msg, 25);
-                fflush(stdout);
-            }
-            // save status of foreground process
-            *status = child_status;
-
-        }
-    }
-  
-    pid_t bg_pid;
-    // check status of background processes
-    bg_pid = check_background_processes();
-    // a process has terminated, update list of background pids
-    if (bg_pid) {
-        remove_pid_from_processes(bg_pid, processes, num_processes);
-    }
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "commands.h"
+#include "spawn.h"
+#include "cmdhash.h"
+#include "relay.h"
+#include "jobs.h"
+#include "utilities.h"
+#include "parallel.h"
+#include "stats.h"
+#include "vars.h"
+#include "pathglob.h"
+#include "trace.h"
+#include "reader.h"
+#include "server.h"
+
+
+int* copy_fg_mode; 
+int has_terminal;               // stdin is a terminal, jobs are given it while in the foreground
+Reader input = {STDIN_FILENO, NULL, 0, 0, 0, 0, wait_for_input};     // commands typed or piped to the shell
+Reader* utility_input = NULL;   // the shell's input while a utility runs in the shell with stdin not redirected
+pid_t shell_pgid;               // process group of the shell, takes the terminal back after a job
+Usage foreground_usage;         // time and resources used by the last foreground command, for status -v
+int foreground_timed_out;       // 1 == the last foreground command was killed by its timeout, for status
+int substitution_depth = 0;     // command substitutions running, nested ones count once each
+int leaving_substitution = 0;   // exit ran inside a command substitution, the rest of its commands are skipped
+
+int is_redirect(int type) {
+    switch (type) {
+        case TOKEN_LESS:
+        case TOKEN_GREAT:
+        case TOKEN_HERE_DOC:
+        case TOKEN_HERE_STRING:
+        case TOKEN_DGREAT:
+        case TOKEN_CLOBBER:
+        case TOKEN_LESS_GREAT:
+        case TOKEN_GREAT_AMP:
+        case TOKEN_LESS_AMP:
+        case TOKEN_AMP_GREAT:
+        case TOKEN_AMP_DGREAT:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int is_fd_word(char* text) {
+    // Checks if text names a descriptor for >& or <&: a number, or - to close it
+    if (strcmp(text, "-") == 0) {
+        return 1;
+    }
+    for (; *text; text++) {
+        if (*text < '0' || *text > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int is_assignment_only(Token tokens[], int num_tokens) {
+    // Checks if the tokens of a stage are all NAME=value words, which set variables instead of running a command
+    int i;
+
+    for (i = 0; i < num_tokens; i++) {
+        if (tokens[i].type != TOKEN_WORD || !is_assignment(tokens[i].text)) {
+            return 0;
+        }
+    }
+    return num_tokens > 0;
+}
+
+int check_input_validity(Token tokens[], int num_tokens) {
+    // Checks if the arguments provided come before any file redirection
+    // Returns 1 if they do, otherwise returns 0
+
+    int redirecting = 0;        // a redirection was seen, only redirections may follow
+    int has_command = 0;        // a word that isn't a NAME=value assignment was seen
+    int i; 
+
+    // first token is the command
+    if (num_tokens == 0 || tokens[0].type != TOKEN_WORD) {
+        return 0;
+    }
+
+    for (i = 0; i < num_tokens; i++) {
+        switch (tokens[i].type) {
+            case TOKEN_WORD:
+                // midline comment encountered, or an argument after a redirect
+                if (strcmp(tokens[i].text, "//") == 0 || redirecting) {
+                    return 0;
+                }
+                has_command |= !is_assignment(tokens[i].text);
+                break;
+
+            case TOKEN_IO_NUMBER:
+                // the redirection it names follows
+                redirecting = 1;
+                break;
+
+            default:
+                // redirect needs a filename, a descriptor to copy, or the here-document or here-string
+                if (i + 1 == num_tokens || tokens[i + 1].type != TOKEN_WORD) {
+                    return 0;
+                }
+                if ((tokens[i].type == TOKEN_GREAT_AMP || tokens[i].type == TOKEN_LESS_AMP)
+                    && !is_fd_word(tokens[i + 1].text)) {
+                    return 0;
+                }
+                redirecting = 1;
+                i++;
+                break;
+        }
+    }
+
+    // assignments with no command set variables in the shell, so they can't be redirected or run in the background
+    return has_command || is_assignment_only(tokens, num_tokens);
+}
+
+int check_pipeline_validity(Token tokens[], int num_tokens) {
+    // Checks every stage of a pipeline, stages are separated by '|'
+    // Returns 1 if all stages are valid, otherwise returns 0
+
+    int start = 0;          // first token of the current stage
+    int i;
+
+    for (i = 0; i <= num_tokens; i++) {
+        // end of a stage
+        if (i == num_tokens || tokens[i].type == TOKEN_PIPE) {
+            if (!check_input_validity(&tokens[start], i - start)) {
+                return 0;
+            }
+            // every stage of a longer pipeline is a process, which needs a command
+            if ((start > 0 || i < num_tokens) && is_assignment_only(&tokens[start], i - start)) {
+                return 0;
+            }
+            start = i + 1;
+        }
+    }
+    return 1;
+}
+
+int init_redirection(Redirection* redirect, int token_type, int fd, Token* word, Arena* arena) {
+    /*
+    Initializes the redirections given by a redirection operator, fd is the descriptor written before it or -1.
+    &> and &>> send both stdout and stderr to the file and take two entries, every other operator one.
+    Returns the number of entries initialized.
+    */
+    int default_fd = 1;
+
+    redirect->source_fd = -1;
+    redirect->target = word->text;
+    redirect->word = word;
+
+    switch (token_type) {
+        case TOKEN_LESS: redirect->type = REDIRECT_INPUT; default_fd = 0; break;
+        case TOKEN_LESS_GREAT: redirect->type = REDIRECT_READ_WRITE; default_fd = 0; break;
+        case TOKEN_GREAT: redirect->type = REDIRECT_OUTPUT; break;
+        case TOKEN_CLOBBER: redirect->type = REDIRECT_CLOBBER; break;
+        case TOKEN_DGREAT: redirect->type = REDIRECT_APPEND; break;
+
+        // copies of descriptors, - closes fd instead
+        case TOKEN_LESS_AMP:
+        case TOKEN_GREAT_AMP:
+            redirect->type = REDIRECT_DUP;
+            redirect->source_fd = strcmp(word->text, "-") == 0 ? -1 : atoi(word->text);
+            redirect->word = NULL;
+            default_fd = token_type == TOKEN_LESS_AMP ? 0 : 1;
+            break;
+
+        // here-document, its body was read into the word after the operator
+        case TOKEN_HERE_DOC:
+            redirect->type = REDIRECT_TEXT;
+            default_fd = 0;
+            break;
+
+        // here-string, the word followed by a newline, which keeps the word's expansions where they were
+        case TOKEN_HERE_STRING:
+            redirect->type = REDIRECT_TEXT;
+            redirect->word = arena_alloc(arena, sizeof(Token));
+            *redirect->word = *word;
+            redirect->word->text = arena_alloc(arena, strlen(word->text) + 2);
+            sprintf(redirect->word->text, "%s\n", word->text);
+            redirect->target = redirect->word->text;
+            default_fd = 0;
+            break;
+
+        // &> and &>>: stdout to the file, then stderr a copy of it
+        default:
+            redirect->type = token_type == TOKEN_AMP_DGREAT ? REDIRECT_APPEND : REDIRECT_OUTPUT;
+            redirect->fd = 1;
+            redirect[1].type = REDIRECT_DUP;
+            redirect[1].fd = 2;
+            redirect[1].source_fd = 1;
+            redirect[1].target = NULL;
+            redirect[1].word = NULL;
+            return 2;
+    }
+
+    redirect->fd = fd == -1 ? default_fd : fd;
+    return 1;
+}
+
+void init_command(Command* cmd, Token tokens[], int num_tokens, Arena* arena) {
+    /*
+    Initializes the Command struct with the tokens provided, its argument and redirection lists are allocated 
+    from arena. The Command refers to the text of the tokens, it must live as long as the Command does.
+    */
+   
+    int num_assigns = 0;    // NAME=value words before the command
+    int num_args = 0;       // tokens that are arguments, filenames after a redirect aren't
+    int num_redirects = 0;  // entries of the redirection list
+    int i;
+    for (i = 0; i < num_tokens; i++) {
+        if (tokens[i].type == TOKEN_WORD && (i == 0 || !is_redirect(tokens[i - 1].type))) {
+            if (num_args == 0 && is_assignment(tokens[i].text)) {
+                num_assigns++;
+            }
+            else {
+                num_args++;
+            }
+        }
+        else if (is_redirect(tokens[i].type)) {
+            num_redirects += tokens[i].type == TOKEN_AMP_GREAT || tokens[i].type == TOKEN_AMP_DGREAT ? 2 : 1;
+        }
+    }
+
+    // initialize all struct data members to null
+    cmd->assigns = arena_alloc(arena, (num_assigns + num_args + 1) * sizeof(char*));
+    cmd->num_assigns = num_assigns;
+    cmd->args = cmd->assigns + num_assigns;
+    cmd->args[num_args] = NULL;
+    cmd->words = arena_alloc(arena, (num_assigns + num_args + 1) * sizeof(Token*));
+    cmd->words[num_assigns + num_args] = NULL;
+    cmd->envp = NULL;
+    cmd->command = NULL;
+    cmd->exec_path = NULL;
+    cmd->utility = NULL;
+    cmd->redirects = num_redirects ? arena_alloc(arena, num_redirects * sizeof(Redirection)) : NULL;
+    cmd->num_redirects = 0;
+    cmd->is_bg = 0;
+    cmd->is_timed = 0;
+    cmd->timeout = 0;
+    memset(cmd->limits, 0, sizeof(cmd->limits));
+    cmd->next = NULL;
+    cmd->group = NULL;
+    cmd->list_next = NULL;
+    cmd->list_op = TOKEN_SEMI;
+    
+    int j = 0;
+    int fd = -1;            // descriptor named before the next redirection, -1 for its default
+
+    // go through provided tokens and initialize Command struct
+    for (i = 0; i < num_tokens; i++) {
+        switch (tokens[i].type) {
+            // assignment or regular argument, the assignments come first
+            case TOKEN_WORD:
+                cmd->assigns[j] = tokens[i].text;
+                cmd->words[j] = &tokens[i];
+                j++;
+                break;
+
+            // descriptor the next redirection applies to
+            case TOKEN_IO_NUMBER:
+                fd = atoi(tokens[i].text);
+                break;
+
+            // redirection, kept in the order given
+            default:
+                cmd->num_redirects += init_redirection(&cmd->redirects[cmd->num_redirects], tokens[i].type, fd,
+                                                       &tokens[i + 1], arena);
+                fd = -1;
+                i++;
+                break;
+        }
+    }
+
+    // first word after the assignments is the command, a group or a line of assignments has none
+    cmd->command = cmd->args[0];
+}
+
+void init_pipeline(Command* cmd, Token tokens[], int num_tokens, Arena* arena) {
+    /*
+    Initializes one Command struct per pipeline stage, linked through next starting at cmd.
+    Stages after the first are allocated from arena.
+    */
+
+    Command* stage = cmd;   // stage being initialized
+    int start = 0;          // first token of the current stage
+    int i;
+
+    for (i = 0; i <= num_tokens; i++) {
+        // still inside the current stage
+        if (i < num_tokens && tokens[i].type != TOKEN_PIPE) {
+            continue;
+        }
+
+        init_command(stage, &tokens[start], i - start, arena);
+
+        // another stage follows
+        if (i < num_tokens) {
+            stage->next = arena_alloc(arena, sizeof(Command));
+            stage = stage->next;
+        }
+        start = i + 1;
+    }
+}
+
+int check_line(char* input, int num_chars) {
+    /*
+    Checks if a line of input holds a command.
+    Returns 0 for blank lines and comments, otherwise returns 1.
+    */
+
+    // initialize flags
+    int blank_line_provided = num_chars < 1;
+    int comment_line_provided = input[0] == '#';
+
+    // Don't tokenize the input if blank or is a comment
+    return !(blank_line_provided || comment_line_provided);
+}
+
+int is_list_operator(Token* token) {
+    // '&' ends a list element like ';', and runs the pipeline before it in the background
+    return token->type == TOKEN_SEMI || token->type == TOKEN_AMP || token->type == TOKEN_AND_IF
+           || token->type == TOKEN_OR_IF;
+}
+
+int is_word(Token* token, char* text) {
+    // Checks if token is the word text, as "{" and "}" are recognized where a command starts
+    return token->type == TOKEN_WORD && strcmp(token->text, text) == 0;
+}
+
+Command* parse_pipeline(Token tokens[], int num_tokens, Arena* arena) {
+    /*
+    Checks the tokens of one pipeline, with an optional leading "time", and initializes its Commands.
+    Returns the first stage, or NULL if the tokens don't form a valid pipeline.
+    */
+
+    // a leading "time" reports what the command used once it has run
+    int is_timed = num_tokens > 1 && tokens[1].type == TOKEN_WORD && is_word(&tokens[0], "time");
+    if (is_timed) {
+        tokens++;
+        num_tokens--;
+    }
+
+    if (!check_pipeline_validity(tokens, num_tokens)) {
+        return NULL;
+    }
+
+    Command* cmd = arena_alloc(arena, sizeof(Command));
+    init_pipeline(cmd, tokens, num_tokens, arena);
+    cmd->is_timed = is_timed;
+    return cmd;
+}
+
+Command* parse_list(Token tokens[], int num_tokens, int* pos, int in_group, Arena* arena) {
+    /*
+    Parses the list of pipelines and groups starting at tokens[*pos], joined by ';', '&', '&&', or '||'.
+    A list ends with the tokens, or at the "}" closing the group it is in, which *pos is left on.
+    Returns the first command of the list, or NULL if the tokens don't form a valid list.
+    */
+    Command* first = NULL;
+    Command* last = NULL;
+    Command* cmd;
+
+    while (1) {
+        // end of the list, only a group's is a "}", and only a ';' may have no command after it
+        if (*pos == num_tokens || is_word(&tokens[*pos], "}")) {
+            int closed = *pos < num_tokens;
+            return first && closed == in_group && last->list_op == TOKEN_SEMI ? first : NULL;
+        }
+
+        // group, run in the shell itself
+        if (is_word(&tokens[*pos], "{")) {
+            (*pos)++;
+            Command* group = parse_list(tokens, num_tokens, pos, 1, arena);
+            if (group == NULL) {
+                return NULL;
+            }
+            (*pos)++;
+
+            // a group can't be redirected or run in the background
+            if (*pos < num_tokens && (!is_list_operator(&tokens[*pos]) || tokens[*pos].type == TOKEN_AMP)
+                && !is_word(&tokens[*pos], "}")) {
+                return NULL;
+            }
+
+            cmd = arena_alloc(arena, sizeof(Command));
+            init_command(cmd, tokens, 0, arena);
+            cmd->group = group;
+        }
+        // pipeline, up to the next list operator
+        else {
+            int start = *pos;
+            while (*pos < num_tokens && !is_list_operator(&tokens[*pos])) {
+                (*pos)++;
+            }
+            cmd = parse_pipeline(&tokens[start], *pos - start, arena);
+            if (cmd == NULL) {
+                return NULL;
+            }
+        }
+
+        if (last) {
+            last->list_next = cmd;
+        }
+        else {
+            first = cmd;
+        }
+        last = cmd;
+
+        // "a & b" runs a in the background and goes on with b as "a; b" would
+        if (*pos < num_tokens && tokens[*pos].type == TOKEN_AMP) {
+            cmd->is_bg = 1;
+            (*pos)++;
+        }
+        else if (*pos < num_tokens && is_list_operator(&tokens[*pos])) {
+            cmd->list_op = tokens[(*pos)++].type;
+        }
+    }
+}
+
+Command* parse_tokens(Token tokens[], int num_tokens, Arena* arena) {
+    /*
+    Checks the tokens lexed from one line and initializes a list of Commands, their words are expanded by 
+    expand_command when they run. The Commands and everything they refer to are either in the line or allocated 
+    from arena.
+    Returns the first Command of the list, or NULL if the tokens don't form a valid command list.
+    */
+    int pos = 0;                // next token to parse
+
+    return parse_list(tokens, num_tokens, &pos, 0, arena);
+}
+
+void expand_words(Command* stage, int in_pipeline, Arena* arena) {
+    /*
+    Expands the assignments and arguments of one stage into arrays allocated from arena. The output of an unquoted
+    command substitution in an argument is split into several. An argument that is a pattern is replaced by the 
+    paths it matches, or kept as it is if it matches none. A stage of a longer pipeline whose arguments all expand
+    to nothing is left an empty command, which fails to run, instead of no command.
+    */
+    int num_words = 0;
+    int capacity;
+    int n = 0;                  // words expanded so far
+    int i;
+    int j;
+
+    for (num_words = 0; stage->words[num_words]; num_words++) {
+        ;
+    }
+    capacity = num_words + 1;
+    char** words = arena_alloc(arena, capacity * sizeof(char*));
+
+    for (i = 0; i < num_words; i++) {
+        char* text;
+        char** fields = &text;
+        int num_fields = 1;
+
+        // assignments are never split
+        if (i < stage->num_assigns) {
+            text = expand_word(stage->words[i], arena);
+        }
+        else {
+            num_fields = expand_fields(stage->words[i], &fields, arena);
+        }
+
+        for (j = 0; j < num_fields; j++) {
+            char** paths = &fields[j];
+            int num_paths = 0;
+
+            if (stage->words[i]->is_pattern) {
+                num_paths = expand_pattern(fields[j], &paths, arena);
+            }
+            if (num_paths == 0) {
+                num_paths = 1;
+            }
+
+            // splitting or a pattern made the words outgrow the array
+            if (n + num_paths + 1 > capacity) {
+                capacity = (n + num_paths + num_words - i) * 2;
+                char** grown = arena_alloc(arena, capacity * sizeof(char*));
+                memcpy(grown, words, n * sizeof(char*));
+                words = grown;
+            }
+            memcpy(&words[n], paths, num_paths * sizeof(char*));
+            n += num_paths;
+        }
+    }
+    if (in_pipeline && n == stage->num_assigns) {
+        words[n++] = "";
+    }
+    words[n] = NULL;
+
+    stage->assigns = words;
+    stage->args = words + stage->num_assigns;
+    stage->command = stage->args[0];
+}
+
+void expand_command(Command* cmd, Arena* arena) {
+    /*
+    Expands the words of every stage of a pipeline into its assignments, arguments, and redirection targets right
+    before it runs, so each command of a list sees the variables and $? the ones before it left. Words with 
+    nothing to expand keep their text, the others are built in arena. Directories read for patterns are cached 
+    until the whole pipeline is expanded, or the whole line with set -o dircache.
+    */
+    Command* stage;
+    int i;
+
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        expand_words(stage, cmd->next != NULL, arena);
+
+        for (i = 0; i < stage->num_redirects; i++) {
+            if (stage->redirects[i].word) {
+                stage->redirects[i].target = expand_word(stage->redirects[i].word, arena);
+            }
+        }
+    }
+
+    if (!dircache) {
+        forget_directories();
+    }
+}
+
+long parse_size(char* text) {
+    // Returns the bytes in a size such as 4096, 512K, 64M, or 2G, or -1 if text isn't a size
+    char* end;
+    int shift = 0;
+    long value;
+
+    errno = 0;
+    value = strtol(text, &end, 10);
+    if (end == text || value <= 0 || errno == ERANGE) {
+        return -1;
+    }
+    switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+    }
+    // a size too large for a long is refused rather than wrapped to a small or negative limit
+    if (*end != '\0' || value > LONG_MAX >> shift) {
+        return -1;
+    }
+    return value << shift;
+}
+
+int take_limit(Command* stage, char* option, char* value) {
+    // Sets the limit of one limit option, returns -1 if the option or its value isn't valid
+    char* end;
+    double seconds;
+    int limit;
+
+    if (value == NULL) {
+        return -1;
+    }
+    if (strcmp(option, "-m") == 0) {
+        limit = LIMIT_MEMORY;
+        stage->limits[limit] = parse_size(value);
+    }
+    else if (strcmp(option, "-t") == 0) {
+        // RLIMIT_CPU counts whole seconds
+        limit = LIMIT_CPU;
+        seconds = parse_duration(value);
+        stage->limits[limit] = seconds > 0 ? (long)seconds + (seconds > (long)seconds) : -1;
+    }
+    else if (strcmp(option, "-n") == 0) {
+        limit = LIMIT_FILES;
+        stage->limits[limit] = strtol(value, &end, 10);
+        if (*end != '\0') {
+            return -1;
+        }
+    }
+    else {
+        return -1;
+    }
+    return stage->limits[limit] > 0 ? 0 : -1;
+}
+
+int take_prefixes(Command* cmd) {
+    /*
+    Turns the timeout and limit commands at the start of each expanded stage into settings of the command that
+    follows them, which then runs as a process:
+        timeout duration command [arg ...]      kills the job's process group once duration has passed
+        limit [-m memory] [-t cpu] [-n files] command [arg ...]     sets resource limits before exec
+    They can be nested. A job gets the shortest timeout of its stages.
+    Returns 0, or -1 after printing a usage message if a prefix is malformed or has no command after it.
+    */
+    Command* stage;
+
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        char** args = stage->args;
+
+        while (args[0] && (strcmp(args[0], "timeout") == 0 || strcmp(args[0], "limit") == 0)) {
+            if (args[0][0] == 't') {
+                double timeout = args[1] ? parse_duration(args[1]) : -1;
+                if (timeout <= 0 || args[2] == NULL) {
+                    printf("usage: timeout duration command [arg ...]\n");
+                    fflush(stdout);
+                    return -1;
+                }
+                if (stage->timeout == 0 || timeout < stage->timeout) {
+                    stage->timeout = timeout;
+                }
+                args += 2;
+                continue;
+            }
+
+            for (args++; args[0] && args[0][0] == '-'; args += 2) {
+                if (take_limit(stage, args[0], args[1]) == -1) {
+                    break;
+                }
+            }
+            if (args[0] == NULL || args[0][0] == '-') {
+                printf("usage: limit [-m memory] [-t cpu] [-n files] command [arg ...]\n");
+                fflush(stdout);
+                return -1;
+            }
+        }
+
+        // the assignments before the prefixes move up to stay right before the arguments
+        if (args != stage->args) {
+            int skipped = args - stage->args;
+            memmove(stage->assigns + skipped, stage->assigns, stage->num_assigns * sizeof(char*));
+            stage->assigns += skipped;
+            stage->args = args;
+            stage->command = args[0];
+        }
+    }
+    return 0;
+}
+
+char* read_input_line(void* reader) {
+    // LineReader for here-documents typed after a command, prompting for each line on a terminal
+    int len;
+
+    if (has_terminal) {
+        printf("> ");
+        flush_output();
+    }
+    return next_line(reader, &len);
+}
+
+Command* get_command(Arena* arena) {
+    /*
+    Prompts the user for commands and initializes a Command struct.
+    The Command is allocated from arena and refers to the input line, both stay valid until the next call, 
+    the caller resets arena once the command has run.
+    Returns: Command struct, or NULL at the end of input.
+    */
+
+    // command struct
+    Command* cmd = NULL;
+
+    // tokens of the line
+    Token* tokens;
+
+    // line in the input buffer
+    char* line;
+    
+    int num_chars;
+    int num_tokens;
+
+    //Prompt user and read input until a valid input is provided
+    do {
+        // report background processes that terminated since the last prompt
+        report_finished_jobs();
+
+        // the notices and the prompt are written together, and only once the shell would block for input,
+        // a --serve session has no prompt, its client waits for status records instead
+        if (!serving) {
+            printf(": ");
+        }
+        if (!has_line(&input)) {
+            flush_output();
+        }
+        line = next_line(&input, &num_chars);
+        if (line == NULL) {
+            return NULL;
+        }
+
+        // Tokenize input, check if valid, and initialize Command struct
+        double start = TRACE_BEGIN();
+        if (check_line(line, num_chars)) {
+            // reading a here-document can move the buffer the line is in
+            if (strstr(line, "<<")) {
+                line = arena_strdup(arena, line);
+            }
+            num_tokens = lex_line(line, &tokens, arena);
+            if (num_tokens > 0) {
+                read_here_documents(tokens, num_tokens, read_input_line, &input, arena);
+                cmd = parse_tokens(tokens, num_tokens, arena);
+            }
+        }
+        TRACE_END(TRACE_PARSE, start, -1);
+    } while (cmd == NULL);
+
+    return cmd;
+}
+
+char *safe(char *s) {
+    // Safely print null strings
+    return s ? s : "NULL";
+}
+
+void display_command(Command* cmd) {
+    printf("command: %s\n", safe(cmd->command));
+    fflush(stdout);
+
+    int i = 0;
+    char* arg;
+    while ((arg = cmd->args[i]) != NULL) {
+        printf("arg[%d]: %s\n", i, safe(arg));
+        fflush(stdout);
+        i++;
+    }
+
+    for (i = 0; i < cmd->num_redirects; i++) {
+        Redirection* redirect = &cmd->redirects[i];
+        printf("redirect[%d]: type %d fd %d source fd %d target %s\n", i, redirect->type, redirect->fd,
+               redirect->source_fd, safe(redirect->target));
+        fflush(stdout);
+    }
+    printf("is_bg: %d\n", cmd->is_bg);
+    fflush(stdout);
+};
+
+void exit_cmd(int exit_value, double timeout) {
+    /*
+    Built-in exit command, exits the shell with exit_value.
+    Kills all processes that have been started before terminating, those still running after timeout seconds
+    are killed with SIGKILL.
+    */
+
+    // processes have been started, terminate all of background processes before exiting
+    if (num_jobs() > 0) {
+        terminate_jobs(timeout);
+    }
+
+    // --trace file: the events of the whole session
+    if (trace_exit_path && trace_write(trace_exit_path) == -1) {
+        perror(trace_exit_path);
+    }
+
+    // --serve: the last record carries the exit status of the session
+    if (serving) {
+        send_status(exit_value);
+    }
+    exit(exit_value);
+}
+
+void status_cmd(int status) {
+    /*
+    Prints out the exit status or the terminating signal of the last foreground process ran by the shell.
+    Returns exit status of 0 if called before any non-built-in foreground command is run.
+    */
+    
+    // process was terminated normally, print status value
+    if (WIFEXITED(status)) {
+        printf("exit value %d\n", WEXITSTATUS(status));
+        fflush(stdout);
+    }
+    // process was terminated abnormally, print signal number that caused the termination
+    else {
+        printf("terminated by signal %d%s\n", WTERMSIG(status), foreground_timed_out ? " after its timeout" : "");
+        fflush(stdout);
+    }
+}
+
+int cd_cmd(Command* cmd) {
+    /*
+    Changes current directory to the directory provided, if none provided it changes to the home directory.
+    Returns 0 on success, otherwise 1.
+    */
+    int directory_provided = cmd->args[1] ? 1 : 0;
+    
+    // directory name provided, display error message if the path is invalid
+    if (directory_provided) {
+        if (COUNTED(SYSCALL_CHDIR, chdir(cmd->args[1])) != 0) {
+            printf("%s - no such file or directory.\n", cmd->args[1]);
+            fflush(stdout);
+            return 1;
+        }
+    }
+    // no directory name provided, change to home directory
+    else {
+        char* home = getenv("HOME");
+        if (home == NULL || COUNTED(SYSCALL_CHDIR, chdir(home)) != 0) {
+            return 1;
+        }
+    }
+
+    // listings kept by set -o dircache are keyed by relative paths, which now name other directories
+    forget_directories();
+    return 0;
+}
+
+int hash_cmd(Command* cmd) {
+    /*
+    Lists the remembered command paths with their hit counts.
+    hash -r forgets every path, hash name... looks up and remembers the named commands.
+    Returns 1 if a named command isn't found, otherwise 0.
+    */
+    int exit_value = 0;
+    int i;
+
+    // no arguments, list the table
+    if (cmd->args[1] == NULL) {
+        hash_print();
+        return 0;
+    }
+
+    // clear the table
+    if (strcmp(cmd->args[1], "-r") == 0) {
+        hash_clear();
+        return 0;
+    }
+
+    // pre-warm the table with the named commands
+    for (i = 1; cmd->args[i] != NULL; i++) {
+        if (!hash_add(cmd->args[i])) {
+            printf("hash: %s: not found\n", cmd->args[i]);
+            fflush(stdout);
+            exit_value = 1;
+        }
+    }
+    return exit_value;
+}
+
+void exit_built_in(Command* cmd, int* status) {
+    /*
+    exit [--timeout duration] [n]: exits with n, or with the status of the last command like the end of input.
+    A malformed argument fails with 1 and the shell goes on.
+    */
+    char** arg;
+
+    // inside a command substitution exit only ends the substitution, as it would end a subshell
+    if (substitution_depth > 0) {
+        leaving_substitution = 1;
+        *status = 0;
+        return;
+    }
+
+    // exit --timeout duration bounds how long the jobs get to end after SIGTERM
+    double timeout = SHUTDOWN_TIMEOUT;
+    int exit_value = WIFEXITED(*status) ? WEXITSTATUS(*status) : 128 + WTERMSIG(*status);
+    int has_value = 0;
+
+    for (arg = &cmd->args[1]; *arg; arg++) {
+        if (strcmp(*arg, "--timeout") == 0) {
+            timeout = parse_duration(arg[1]);
+            if (timeout < 0) {
+                printf("exit: %s: invalid timeout\n", arg[1] ? arg[1] : "missing");
+                fflush(stdout);
+                *status = W_EXITCODE(1, 0);
+                return;
+            }
+            arg++;
+        }
+        else if (!has_value && **arg && strspn(*arg, "0123456789") == strlen(*arg)) {
+            exit_value = atoi(*arg) & 0xff;
+            has_value = 1;
+        }
+        else {
+            printf("exit: %s: %s\n", *arg, has_value ? "too many arguments" : "numeric argument required");
+            fflush(stdout);
+            *status = W_EXITCODE(1, 0);
+            return;
+        }
+    }
+    exit_cmd(exit_value, timeout);
+}
+
+void cd_built_in(Command* cmd, int* status) {
+    *status = W_EXITCODE(cd_cmd(cmd), 0);
+}
+
+void hash_built_in(Command* cmd, int* status) {
+    *status = W_EXITCODE(hash_cmd(cmd), 0);
+}
+
+void status_built_in(Command* cmd, int* status) {
+    // the status reported is left as it is, status -v can follow status
+    status_cmd(*status);
+
+    // -v adds the time and resources the command used
+    if (cmd->args[1] && strcmp(cmd->args[1], "-v") == 0) {
+        print_usage(stdout, &foreground_usage);
+        printf("\n");
+        fflush(stdout);
+    }
+}
+
+void set_built_in(Command* cmd, int* status) {
+    /*
+    set -C (or -o noclobber) keeps > from overwriting existing files, set +C (or +o noclobber) allows it again.
+    set -o dircache keeps the directories read for patterns until the line has run, set +o dircache only while
+    one pipeline is expanded. With no arguments the options are listed.
+    */
+    char** arg;
+
+    *status = W_EXITCODE(0, 0);
+    if (cmd->args[1] == NULL) {
+        printf("dircache\t%s\n", dircache ? "on" : "off");
+        printf("noclobber\t%s\n", noclobber ? "on" : "off");
+    }
+    for (arg = &cmd->args[1]; *arg; arg++) {
+        char sign = (*arg)[0];                  // - turns the option on, + turns it off
+        char* option = sign == '-' || sign == '+' ? *arg + 1 : "";
+
+        if (strcmp(option, "C") == 0) {
+            noclobber = sign == '-';
+        }
+        else if (strcmp(option, "o") == 0 && arg[1] && strcmp(arg[1], "noclobber") == 0) {
+            noclobber = sign == '-';
+            arg++;
+        }
+        else if (strcmp(option, "o") == 0 && arg[1] && strcmp(arg[1], "dircache") == 0) {
+            dircache = sign == '-';
+            arg++;
+        }
+        else {
+            printf("set: %s: invalid option\n", *arg);
+            *status = W_EXITCODE(1, 0);
+            break;
+        }
+    }
+    fflush(stdout);
+}
+
+int export_utility(char** args) {
+    /*
+    export NAME=value sets a variable and puts it in the environment of commands, export NAME exports a variable
+    already set, or an empty one. With no arguments the exported variables are listed.
+    Exits with 1 if a name isn't valid, otherwise 0.
+    */
+    int exit_value = 0;
+    char** arg;
+
+    if (args[1] == NULL) {
+        print_exported(stdout);
+    }
+    for (arg = &args[1]; *arg; arg++) {
+        int len = name_length(*arg);
+
+        if (len > 0 && (*arg)[len] == '=') {
+            assign(*arg, 1);
+        }
+        else if (len > 0 && (*arg)[len] == '\0') {
+            char* value = get_var(*arg, len);
+            set_var(*arg, len, value ? value : "", 1);
+        }
+        else {
+            printf("export: %s: not a valid identifier\n", *arg);
+            exit_value = 1;
+        }
+    }
+    return exit_value;
+}
+
+void fg_built_in(Command* cmd, int* status) {
+    // Resumes a job in the foreground, the most recent one if none is named
+    Job* job = find_job_spec(cmd->args[1]);
+
+    if (job == NULL) {
+        printf("fg: %s: no such job\n", cmd->args[1] ? cmd->args[1] : "current");
+        fflush(stdout);
+        *status = W_EXITCODE(1, 0);
+        return;
+    }
+    printf("%s\n", job->text);
+    fflush(stdout);
+
+    // SIGCONT is sent once the job owns the terminal, so it doesn't stop again reading from it
+    give_terminal(job->pgid);
+    continue_job(job, 0);
+    run_in_foreground(job->number, job->pgid, NULL, status);
+}
+
+void bg_built_in(Command* cmd, int* status) {
+    // Resumes a stopped job in the background, the most recent one if none is named
+    Job* job = find_job_spec(cmd->args[1]);
+
+    if (job == NULL) {
+        printf("bg: %s: no such job\n", cmd->args[1] ? cmd->args[1] : "current");
+        *status = W_EXITCODE(1, 0);
+    }
+    else {
+        continue_job(job, 1);
+        printf("[%d] %s\n", job->number, job->text);
+        *status = W_EXITCODE(0, 0);
+    }
+    fflush(stdout);
+}
+
+int jobs_utility(char** args) {
+    // Lists every job once the state changes that arrived are recorded
+    report_finished_jobs();
+    list_jobs();
+    return 0;
+}
+
+int wait_utility(char** args) {
+    /*
+    wait [%n | pid]: blocks until the named job terminates, or every running background job if none is named.
+    Exits with the status of the named job, 0 otherwise, or 127 if there is no such job.
+    */
+    Job* job = NULL;
+    int status;
+
+    if (args[1]) {
+        job = find_job_spec(args[1]);
+        if (job == NULL) {
+            printf("wait: %s: no such job\n", args[1]);
+            return 127;
+        }
+    }
+
+    // report what finished before waiting, the notices would otherwise come after
+    report_finished_jobs();
+    status = wait_for_background(job);
+    if (status == -1) {
+        return 128 + SIGTSTP;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+typedef struct BuiltIn {
+    char* name;
+    void (*run)(Command* cmd, int* status);     // shell built-in, acts on the shell itself and sets the status
+    Utility utility;                            // utility run in the shell, its exit value becomes the status
+} BuiltIn;
+
+// sorted by name for bsearch, add new built-ins here
+static const BuiltIn built_ins[] = {
+    {"[", NULL, test_utility},
+    {"bg", bg_built_in, NULL},
+    {"cd", cd_built_in, NULL},
+    {"echo", NULL, echo_utility},
+    {"exit", exit_built_in, NULL},
+    {"export", NULL, export_utility},
+    {"false", NULL, false_utility},
+    {"fg", fg_built_in, NULL},
+    {"hash", hash_built_in, NULL},
+    {"jobs", NULL, jobs_utility},
+    {"parallel", NULL, parallel_utility},
+    {"printf", NULL, printf_utility},
+    {"pwd", NULL, pwd_utility},
+    {"set", set_built_in, NULL},
+    {"stats", NULL, stats_utility},
+    {"status", status_built_in, NULL},
+    {"test", NULL, test_utility},
+    {"trace", NULL, trace_utility},
+    {"true", NULL, true_utility},
+    {"wait", NULL, wait_utility},
+};
+
+int compare_built_in(const void* name, const void* built_in) {
+    return strcmp((const char*)name, ((const BuiltIn*)built_in)->name);
+}
+
+const BuiltIn* find_built_in(char* name) {
+    // Returns the built-in called name, or NULL if there is none
+    return bsearch(name, built_ins, sizeof(built_ins) / sizeof(built_ins[0]), sizeof(BuiltIn), compare_built_in);
+}
+
+Utility find_utility(char* name) {
+    // Returns the utility called name, or NULL if it isn't one
+    const BuiltIn* built_in = find_built_in(name);
+    return built_in ? built_in->utility : NULL;
+}
+
+int built_in_command(Command* cmd) {
+    /*
+    Checks if the command provided is a built-in command
+    Returns 1 if built-in, otherwise return 0
+    */
+    const BuiltIn* built_in;
+
+    // built-ins only run on their own, pipeline stages are always new processes, utilities run in them
+    if (cmd->next) {
+        return 0;
+    }
+
+    // a timeout or limits apply to a process, the command runs as one
+    if (cmd->timeout || cmd->limits[LIMIT_MEMORY] || cmd->limits[LIMIT_CPU] || cmd->limits[LIMIT_FILES]) {
+        return 0;
+    }
+
+    built_in = find_built_in(cmd->command);
+    if (built_in == NULL) {
+        return 0;
+    }
+
+    // utilities in the background can't hold up the shell, they run in a process of their own
+    return !(built_in->utility && cmd->is_bg);
+}
+
+typedef struct SavedFd {
+    int fd;                 // descriptor replaced by a utility's redirection
+    int copy;               // copy of the original to put back, -1 if fd wasn't open
+} SavedFd;
+
+int redirect_built_in(Redirection* redirect, SavedFd* saved, int* num_saved) {
+    /*
+    Applies one redirection to the shell's own descriptors for a utility. The first time a descriptor is
+    redirected a copy of it is added to saved, to be restored with restore_built_in.
+    Returns 1 on success, otherwise prints an error and returns 0.
+    */
+    char msg[512];
+    int fd;
+    int i;
+
+    for (i = 0; i < *num_saved && saved[i].fd != redirect->fd; i++) {
+        ;
+    }
+    if (i == *num_saved) {
+        saved[i].fd = redirect->fd;
+        saved[i].copy = COUNTED(SYSCALL_DUP, fcntl(redirect->fd, F_DUPFD_CLOEXEC, 10));
+        (*num_saved)++;
+    }
+
+    if (redirect->type == REDIRECT_DUP) {
+        if (redirect->source_fd == -1) {
+            COUNTED(SYSCALL_CLOSE, close(redirect->fd));
+            return 1;
+        }
+        fd = COUNTED(SYSCALL_DUP, dup2(redirect->source_fd, redirect->fd));
+    }
+    else {
+        fd = redirect->type == REDIRECT_TEXT ? open_text_input(redirect->target)
+             : COUNTED(SYSCALL_OPEN, open_redirection(redirect));
+        if (fd != -1 && fd != redirect->fd) {
+            COUNTED(SYSCALL_DUP, dup2(fd, redirect->fd));
+            COUNTED(SYSCALL_CLOSE, close(fd));
+        }
+        // opened on the descriptor itself, which was closed, it must stay open for the utility's children
+        else if (fd != -1) {
+            fcntl(fd, F_SETFD, 0);
+        }
+    }
+
+    if (fd == -1) {
+        format_redirect_error(redirect, errno, msg, sizeof(msg));
+        printf("%s", msg);
+        fflush(stdout);
+        return 0;
+    }
+    return 1;
+}
+
+void restore_built_in(SavedFd* saved, int num_saved) {
+    // Puts back the descriptors replaced by redirect_built_in, the last one replaced first
+    int i;
+
+    for (i = num_saved - 1; i >= 0; i--) {
+        if (saved[i].copy == -1) {
+            COUNTED(SYSCALL_CLOSE, close(saved[i].fd));
+        }
+        else {
+            COUNTED(SYSCALL_DUP, dup2(saved[i].copy, saved[i].fd));
+            COUNTED(SYSCALL_CLOSE, close(saved[i].copy));
+        }
+    }
+}
+
+void report_time(Command* cmd, Usage* usage) {
+    // Prints the time and resources a command used on stderr if it was prefixed with "time"
+    if (cmd->is_timed) {
+        print_usage(stderr, usage);
+        fprintf(stderr, "\n");
+    }
+}
+
+void run_utility(Command* cmd, const BuiltIn* built_in, int* status) {
+    /*
+    Runs a utility inside the shell with the command's redirections applied in order to the shell's own 
+    descriptors, which are restored afterwards. The status is set as if the utility had run as a process.
+    */
+    SavedFd* saved = cmd->num_redirects ? malloc(cmd->num_redirects * sizeof(SavedFd)) : NULL;
+    int num_saved = 0;
+    int ready = 1;
+    int exit_value = 1;
+    int i;
+
+    // output still buffered must not follow stdout into the file
+    flush_output();
+
+    for (i = 0; i < cmd->num_redirects && ready; i++) {
+        ready = redirect_built_in(&cmd->redirects[i], saved, &num_saved);
+    }
+
+    // stdin is still the shell's input unless it was redirected, the lines the shell buffered come first
+    utility_input = &input;
+    for (i = 0; i < num_saved; i++) {
+        if (saved[i].fd == STDIN_FILENO) {
+            utility_input = NULL;
+        }
+    }
+    if (ready) {
+        exit_value = built_in->utility(cmd->args);
+        flush_output();
+    }
+    utility_input = NULL;
+
+    restore_built_in(saved, num_saved);
+    free(saved);
+    *status = W_EXITCODE(exit_value, 0);
+}
+
+void run_built_in(Command* cmd, int* status) {
+    /*
+    Runs a built-in inside the shell. Its usage is what the shell used meanwhile, utilities record it as the 
+    foreground command's.
+    */
+    const BuiltIn* built_in = find_built_in(cmd->command);
+    struct timespec start;
+    struct rusage before;
+    struct rusage after;
+    Usage usage = {0};
+    int measured = built_in->utility || cmd->is_timed;     // status -v and time read the resources used
+
+    // assignments before a built-in are in the environment only while it runs
+    char** envp = cmd->num_assigns ? environment_with(cmd->assigns, cmd->num_assigns) : NULL;
+    if (envp) {
+        environ = envp;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (measured) {
+        COUNTED(SYSCALL_GETRUSAGE, getrusage(RUSAGE_SELF, &before));
+    }
+
+    if (built_in->utility) {
+        run_utility(cmd, built_in, status);
+    }
+    else {
+        built_in->run(cmd, status);
+    }
+
+    if (envp) {
+        restore_environment();
+        free(envp);
+    }
+
+    usage.wall_seconds = seconds_since(&start);
+    if (measured) {
+        COUNTED(SYSCALL_GETRUSAGE, getrusage(RUSAGE_SELF, &after));
+        timersub(&after.ru_utime, &before.ru_utime, &usage.rusage.ru_utime);
+        timersub(&after.ru_stime, &before.ru_stime, &usage.rusage.ru_stime);
+        usage.rusage.ru_maxrss = after.ru_maxrss;
+        usage.rusage.ru_minflt = after.ru_minflt - before.ru_minflt;
+        usage.rusage.ru_majflt = after.ru_majflt - before.ru_majflt;
+        usage.rusage.ru_nvcsw = after.ru_nvcsw - before.ru_nvcsw;
+        usage.rusage.ru_nivcsw = after.ru_nivcsw - before.ru_nivcsw;
+    }
+
+    if (built_in->utility) {
+        foreground_usage = usage;
+    }
+    report_time(cmd, &usage);
+}
+
+void write_message(char* msg) {
+    // Writes msg without stdio, from a signal handler, and never its terminator
+    write(STDOUT_FILENO, msg, strlen(msg));
+}
+
+void handle_SIGTSTP(int signo) {
+    // currently in regular mode
+    if (*copy_fg_mode == 0) {
+        // change to foreground mode
+        *copy_fg_mode = 1;
+        write_message("\nEntering foreground-only mode (& is now ignored)\n");
+    }
+
+    // currently in foreground mode
+    else {
+        // change to regular mode
+        *copy_fg_mode = 0;
+        write_message("\nExiting foreground-only mode\n");
+    }
+
+    // a --serve session has no prompt, a NUL or ": " would break its client's records
+    if (!serving) {
+        write_message(": ");
+    }
+}  
+
+void check_foreground_mode(Command* cmd) {
+    // When in foreground mode, update all commands to foreground only
+    if (*copy_fg_mode == 1) {
+        cmd->is_bg = 0;
+    } 
+}
+
+void give_terminal(pid_t pgid) {
+    // Makes pgid the foreground process group of the shell's terminal, if the shell has one
+    if (has_terminal) {
+        COUNTED(SYSCALL_TCSETPGRP, tcsetpgrp(STDIN_FILENO, pgid));
+    }
+}
+
+void init_signals(int* foreground_mode) {
+    /*
+    Installs the shell's signal dispositions once at startup, children set up their own before they exec.
+    SIGINT is ignored and SIGTSTP toggles foreground_mode. SIGTTOU is ignored so the shell can take the terminal 
+    back from a job without being stopped.
+    */
+    copy_fg_mode = foreground_mode;                 // global foreground_mode address
+    has_terminal = isatty(STDIN_FILENO);
+    shell_pgid = getpgrp();
+
+    // intialize SIGINT_action struct
+    // source: Signal Handling API module
+    struct sigaction SIGINT_action = {{0}};
+    SIGINT_action.sa_handler = SIG_IGN;              // ignore SIGINT
+    sigfillset(&SIGINT_action.sa_mask);              // block all catchable signals 
+    sigaction(SIGINT, &SIGINT_action, NULL);        // install signal handler
+    sigaction(SIGTTOU, &SIGINT_action, NULL);
+
+    // initialize SIGTSTP_action struct
+    struct sigaction SIGTSTP_action = {{0}};
+    SIGTSTP_action.sa_handler = handle_SIGTSTP;      // handler for SIGTSTP
+    SIGTSTP_action.sa_flags = SA_RESTART;           // restart any interrupted signal calls
+    sigfillset(&SIGTSTP_action.sa_mask);            // block all catchable signals
+    sigaction(SIGTSTP, &SIGTSTP_action, NULL);      // install signal handler
+}
+
+int redirect_text(char* w, Redirection* redirect) {
+    // Writes a redirection to w as it would be typed, a here-document's text is left out, returns the length
+    static const char* operators[] = {"<", ">", ">|", ">>", "<>", ">&", "<<"};
+    int type = redirect->type;
+    int default_fd = type == REDIRECT_INPUT || type == REDIRECT_READ_WRITE || type == REDIRECT_TEXT ? 0 : 1;
+    int len = redirect->fd == default_fd ? sprintf(w, " %s", operators[type])
+              : sprintf(w, " %d%s", redirect->fd, operators[type]);
+
+    if (type == REDIRECT_DUP && redirect->source_fd == -1) {
+        return len + sprintf(w + len, "-");
+    }
+    if (type == REDIRECT_DUP) {
+        return len + sprintf(w + len, "%d", redirect->source_fd);
+    }
+    return len + sprintf(w + len, " %s", type == REDIRECT_TEXT ? "..." : redirect->target);
+}
+
+char* command_text(Command* cmd) {
+    // Returns the command line of cmd rebuilt from its stages for the jobs list, allocated with malloc
+    size_t len = 8;
+    Command* stage;
+    int i;
+
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        for (i = 0; stage->args[i]; i++) {
+            len += strlen(stage->args[i]) + 1;
+        }
+        for (i = 0; i < stage->num_redirects; i++) {
+            Redirection* redirect = &stage->redirects[i];
+            int has_file = redirect->type != REDIRECT_DUP && redirect->type != REDIRECT_TEXT;
+            len += (has_file ? strlen(redirect->target) : 0) + 32;
+        }
+        len += 3;
+    }
+
+    char* text = malloc(len);
+    char* w = text;
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        for (i = 0; stage->args[i]; i++) {
+            w += sprintf(w, i ? " %s" : "%s", stage->args[i]);
+        }
+        for (i = 0; i < stage->num_redirects; i++) {
+            w += redirect_text(w, &stage->redirects[i]);
+        }
+        if (stage->next) {
+            w += sprintf(w, " | ");
+        }
+    }
+    strcpy(w, cmd->is_bg ? " &" : "");
+    return text;
+}
+
+void run_in_foreground(int number, pid_t pgid, Command* cmd, int* status) {
+    /*
+    Gives job number the terminal and waits for it to terminate or stop. cmd is the job's command if it was just 
+    started, NULL when fg resumed it. A job that terminates sets the status and usage of the foreground command.
+    */
+    Usage usage = {0};
+    int child_status;
+    int timed_out = 0;
+
+    // the job gets the terminal so keyboard signals reach all of its processes
+    give_terminal(pgid);
+    double start = TRACE_BEGIN();
+    int stopped = wait_for_job(number, &child_status, &usage, &timed_out);
+    TRACE_END(TRACE_WAIT, start, pgid);
+    give_terminal(shell_pgid);
+
+    // a stopped job stays in the jobs list, the status is left as it was
+    if (stopped) {
+        fflush(stdout);
+        return;
+    }
+
+    // foreground process was terminated abnormally, or killed by its timeout
+    if (WIFSIGNALED(child_status)) {
+        printf("\nterminated by signal %d%s\n", WTERMSIG(child_status), timed_out ? " after its timeout" : "");
+        fflush(stdout);
+    }
+    // save status and usage of foreground process
+    *status = child_status;
+    foreground_usage = usage;
+    foreground_timed_out = timed_out;
+    if (cmd) {
+        report_time(cmd, &usage);
+    }
+}
+
+void run_external_command(Command* cmd, int* status, int* foreground_mode) {
+    /*
+    Executes all external commands, a pipeline runs one process per stage.
+    */
+
+    check_foreground_mode(cmd);
+    pid_t spawn_pid = -2;
+    int background_process = cmd->is_bg;        // run in background?
+    struct timespec start;                      // when the first stage was started
+
+    int num_stages = 0;                         // number of pipeline stages
+    Command* stage;                             // stage being started
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        num_stages++;
+    }
+
+    pid_t* stage_pids = malloc(num_stages * sizeof(pid_t));    // pid of every stage
+    pid_t pgid = 0;                             // every job has a process group led by its first stage
+    int in_fd = -1;                             // read end of the pipe from the previous stage
+    int pipe_fds[2];                            // pipe to the next stage
+    int i = 0;
+
+    // output the shell buffered must come out before anything the children write
+    flush_output();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (stage = cmd; stage != NULL; stage = stage->next, i++) {
+        int out_fd = -1;                        // write end of the pipe to the next stage
+        stage->is_bg = background_process;
+
+        // connect this stage to the next one, the pipe is closed in every child when it execs
+        if (stage->next) {
+            if (COUNTED(SYSCALL_PIPE2, pipe2(pipe_fds, O_CLOEXEC)) == -1) {
+                printf("pipe() failed!\n");
+                fflush(stdout);
+                exit(1);
+            }
+            out_fd = pipe_fds[1];
+        }
+
+        // find the command once in the parent instead of searching PATH on every exec, a utility isn't executed
+        stage->utility = find_utility(stage->command);
+        stage->exec_path = is_relay_stage(stage) || stage->utility ? NULL : hash_lookup(stage->command);
+
+        // assignments before the command are added to its environment only
+        stage->envp = stage->num_assigns ? environment_with(stage->assigns, stage->num_assigns) : NULL;
+
+        // start the child, it sets up its own signals and redirections before executing the command
+        double spawn_start = TRACE_BEGIN();
+        spawn_pid = spawn_command(stage, in_fd, out_fd, pgid);
+        TRACE_END(TRACE_SPAWN, spawn_start, spawn_pid);
+        free(stage->envp);
+        stage->envp = NULL;
+
+        // spawn failed
+        if (spawn_pid == -1) {
+            printf("fork() failed!\n");
+            fflush(stdout);
+            exit(1);
+        }
+        if (pgid == 0) {
+            pgid = spawn_pid;
+        }
+        stage_pids[i] = spawn_pid;
+
+        // the children own the pipe ends now
+        if (in_fd != -1) {
+            COUNTED(SYSCALL_CLOSE, close(in_fd));
+        }
+        if (out_fd != -1) {
+            COUNTED(SYSCALL_CLOSE, close(out_fd));
+        }
+        in_fd = stage->next ? pipe_fds[0] : -1;
+    }
+
+    int number = add_job(pgid, stage_pids, num_stages, background_process, command_text(cmd), &start);
+
+    // timeout prefix: the shortest timeout of the stages kills the whole job
+    double timeout = 0;
+    for (stage = cmd; stage != NULL; stage = stage->next) {
+        if (stage->timeout && (timeout == 0 || stage->timeout < timeout)) {
+            timeout = stage->timeout;
+        }
+    }
+    if (timeout) {
+        set_deadline(number, timeout);
+    }
+
+    // command ran in background
+    if (background_process) {
+        // don't wait for the processes to terminate, they are reaped before a later prompt
+        for (i = 0; i < num_stages; i++) {
+            printf("background pid is %d\n", stage_pids[i]);
+        }
+        set_background_pid(stage_pids[num_stages - 1]);
+    }
+    // command ran in foreground
+    else {
+        run_in_foreground(number, pgid, cmd, status);
+    }
+    free(stage_pids);
 }
\ No newline at end of file
@@ -1,15 +1,73 @@
-#define MAX_ARGS 512        // max number of arguments
-
-typedef struct Commands {
-    char* command;          // command
-    char* args[MAX_ARGS];   // arguments exclude input and output filenames and bg flag
-    char* input_file;       // input filename
-    char* output_file;      // output filename
-    int is_bg;              // 1 == background process, 0 == foreground process
-} Command;
-
-Command get_command(pid_t shell_pid);
-int built_in_command(Command* cmd);
-void run_built_in(Command* cmd, int* process_status, int num_processes_running, pid_t processes[]);
-void display_command(Command* cmd);
-void run_external_command(Command* cmd, int* status, pid_t processes[], int* num_processes, int* foreground_mode);
\ No newline at end of file
+#include "arena.h"
+#include "lexer.h"
+#include "reader.h"
+
+#define SHUTDOWN_TIMEOUT 2.0    // seconds jobs get to end after SIGTERM when the shell exits, before SIGKILL
+
+#define LIMIT_MEMORY 0          // limit -m: address space in bytes, RLIMIT_AS
+#define LIMIT_CPU 1             // limit -t: CPU seconds, RLIMIT_CPU
+#define LIMIT_FILES 2           // limit -n: open descriptors, RLIMIT_NOFILE
+#define NUM_LIMITS 3
+
+#define REDIRECT_INPUT 0        // n< file, n defaults to 0
+#define REDIRECT_OUTPUT 1       // n> file, n defaults to 1, fails on an existing file with noclobber
+#define REDIRECT_CLOBBER 2      // n>| file, truncates the file even with noclobber
+#define REDIRECT_APPEND 3       // n>> file
+#define REDIRECT_READ_WRITE 4   // n<> file, n defaults to 0
+#define REDIRECT_DUP 5          // n>&m or n<&m makes n a copy of m, n>&- closes n
+#define REDIRECT_TEXT 6         // here-document or here-string, n defaults to 0
+
+typedef struct Redirection {
+    int type;               // REDIRECT_* value
+    int fd;                 // descriptor redirected
+    int source_fd;          // REDIRECT_DUP: descriptor copied, -1 to close fd
+                            // REDIRECT_TEXT: descriptor holding the text, set just before the command runs
+    char* target;           // filename, or the text of a here-document or here-string, expanded before it runs
+    Token* word;            // word target is expanded from, NULL if it has none
+} Redirection;
+
+// utility run inside the shell or, as a pipeline stage or in the background, inside its forked child
+typedef int (*Utility)(char** args);
+
+typedef struct Commands {
+    char* command;          // command
+    char* exec_path;        // absolute path of the command from the hash table, NULL to search PATH
+    Utility utility;        // utility the child runs instead of executing a program, set just before it starts
+    char** args;            // NULL-terminated, arguments exclude redirections and bg flag
+    char** assigns;         // NAME=value words before the command, args follows them in the same array
+    int num_assigns;
+    Token** words;          // word of every assignment and argument, expanded into assigns and args before it runs
+    char** envp;            // environment of the command when it has assignments, NULL for the shell's
+    Redirection* redirects; // redirections in the order given, applied one after the other
+    int num_redirects;
+    int is_bg;              // 1 == background process, 0 == foreground process
+    int is_timed;           // 1 == prefixed with time, report the time and resources used
+    double timeout;         // timeout prefix: seconds after which the job is killed, 0 for none
+    long limits[NUM_LIMITS];    // limit prefix: resource limits set in the child before exec, 0 for none
+    struct Commands* next;  // next stage of a pipeline, NULL for the last stage
+    struct Commands* group; // commands of a { ...; } group, which has no command of its own, otherwise NULL
+    struct Commands* list_next; // command after this one in a list, NULL for the last
+    int list_op;            // TOKEN_SEMI, TOKEN_AND_IF, or TOKEN_OR_IF: when list_next runs after this command,
+                            // '&' sets is_bg and leaves TOKEN_SEMI
+} Command;
+
+extern int substitution_depth;
+extern int leaving_substitution;
+extern pid_t shell_pgid;
+extern Reader* utility_input;
+
+Command* get_command(Arena* arena);
+int check_line(char* input, int num_chars);
+Command* parse_tokens(Token tokens[], int num_tokens, Arena* arena);
+void expand_command(Command* cmd, Arena* arena);
+int take_prefixes(Command* cmd);
+int built_in_command(Command* cmd);
+Utility find_utility(char* name);
+void run_built_in(Command* cmd, int* process_status);
+void exit_cmd(int exit_value, double timeout);
+void display_command(Command* cmd);
+void give_terminal(pid_t pgid);
+void init_signals(int* foreground_mode);
+char* command_text(Command* cmd);
+void run_in_foreground(int number, pid_t pgid, Command* cmd, int* status);
+void run_external_command(Command* cmd, int* status, int* foreground_mode);
\ No newline at end of file
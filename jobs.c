@@ -0,0 +1,737 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "jobs.h"
+#include "stats.h"
+#include "trace.h"
+
+#define INITIAL_SLOTS 64        // slots allocated on first insert, the table doubles when 3/4 full
+#define INITIAL_JOBS 16         // job numbers allocated on first insert, doubled as needed
+
+#define EMPTY_SLOT 0            // slot never used
+#define REMOVED_SLOT -1         // slot of a reaped process, lookups probe past it
+
+/*
+Every command line that starts processes is a job with its own process group and a job number, the %n of fg, bg
+and wait. A new job gets the number after the highest one in use, like other shells.
+The processes of the jobs are kept in an open-addressing table keyed by pid, so reaping a process is O(1) no
+matter how many are running. SIGCHLD is blocked and read from a signalfd: reaping only happens when a child has
+changed state, and every finished process is reaped at once.
+*/
+typedef struct Slot {
+    pid_t pid;                  // EMPTY_SLOT or REMOVED_SLOT when the slot holds no process
+    Job* job;                   // job the process belongs to
+} Slot;
+
+Slot* slots = NULL;             // processes of the jobs
+int num_slots = 0;
+int num_used = 0;               // slots holding a process or a removed marker
+int num_running = 0;            // slots holding a process
+int sigchld_fd = -1;            // signalfd reporting SIGCHLD
+int sigchld_seen = 0;           // 1 == SIGCHLD was read while waiting for a deadline, reaping is still due
+int timer_fd = -1;              // timerfd armed for the earliest deadline of a job
+int num_deadlines = 0;          // jobs with a deadline that hasn't passed
+double next_deadline = 0;       // monotonic seconds timer_fd expires at, 0 when disarmed
+
+Job** jobs = NULL;              // jobs[n - 1] is job n, NULL if there is none
+int jobs_capacity = 0;
+int highest_job = 0;            // highest job number in use
+int num_job_entries = 0;        // jobs in the table
+
+void jobs_init() {
+    /*
+    Blocks SIGCHLD and opens the signalfd it is read from. Children unblock it before they exec.
+    */
+    sigset_t sigchld_mask;
+    sigemptyset(&sigchld_mask);
+    sigaddset(&sigchld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld_mask, NULL);
+
+    sigchld_fd = signalfd(-1, &sigchld_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+}
+
+unsigned int slot_index(pid_t pid) {
+    // First slot to probe for pid
+    return ((unsigned int)pid * 2654435761U) & (num_slots - 1);
+}
+
+int find_slot(pid_t pid) {
+    // Returns the slot holding pid, or -1 if it isn't a process of a job
+    unsigned int i;
+
+    // pids are positive, 0 and -1 would match the markers of empty and removed slots
+    if (num_slots == 0 || pid <= 0) {
+        return -1;
+    }
+    for (i = slot_index(pid); slots[i].pid != EMPTY_SLOT; i = (i + 1) & (num_slots - 1)) {
+        if (slots[i].pid == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void insert_slot(Slot* slot) {
+    // Puts slot in the first free slot, the table must have room
+    unsigned int i;
+
+    for (i = slot_index(slot->pid); slots[i].pid > 0; i = (i + 1) & (num_slots - 1)) {
+        ;
+    }
+    if (slots[i].pid == EMPTY_SLOT) {
+        num_used++;
+    }
+    slots[i] = *slot;
+    num_running++;
+}
+
+void resize_slots(int new_num_slots) {
+    // Moves every process to a new table, dropping removed markers
+    Slot* old_slots = slots;
+    int old_num_slots = num_slots;
+    int i;
+
+    slots = calloc(new_num_slots, sizeof(Slot));
+    num_slots = new_num_slots;
+    num_used = 0;
+    num_running = 0;
+
+    for (i = 0; i < old_num_slots; i++) {
+        if (old_slots[i].pid > 0) {
+            insert_slot(&old_slots[i]);
+        }
+    }
+    free(old_slots);
+}
+
+void add_process(pid_t pid, Job* job) {
+    // Saves the pid of one process of job
+    Slot slot = {pid, job};
+
+    if ((num_used + 1) * 4 > num_slots * 3) {
+        // mostly removed markers: rebuild at the same size, otherwise grow
+        resize_slots(num_slots == 0 ? INITIAL_SLOTS : (num_running + 1) * 2 > num_slots ? num_slots * 2 : num_slots);
+    }
+    insert_slot(&slot);
+}
+
+int add_job(pid_t pgid, pid_t* pids, int num_pids, int is_bg, char* text, struct timespec* start) {
+    /*
+    Saves a job of num_pids processes in process group pgid, started at start. The job owns text, which must be
+    allocated with malloc. Returns the job number.
+    */
+    Job* job = malloc(sizeof(Job) + num_pids * sizeof(pid_t));
+    int i;
+
+    if (highest_job == jobs_capacity) {
+        jobs_capacity = jobs_capacity ? jobs_capacity * 2 : INITIAL_JOBS;
+        jobs = realloc(jobs, jobs_capacity * sizeof(Job*));
+    }
+
+    job->number = ++highest_job;
+    job->pgid = pgid;
+    job->state = JOB_RUNNING;
+    job->is_bg = is_bg;
+    job->text = text;
+    job->start = *start;
+    job->num_pids = num_pids;
+    job->num_live = num_pids;
+    job->status = 0;
+    job->deadline = 0;
+    job->timed_out = 0;
+    memset(&job->usage, 0, sizeof(job->usage));
+    memcpy(job->pids, pids, num_pids * sizeof(pid_t));
+
+    jobs[job->number - 1] = job;
+    num_job_entries++;
+    for (i = 0; i < num_pids; i++) {
+        add_process(pids[i], job);
+    }
+    return job->number;
+}
+
+void arm_timer(double deadline) {
+    // Arms timer_fd to expire at deadline, in monotonic seconds, or disarms it if deadline is 0
+    struct itimerspec when = {{0, 0}, {(time_t)deadline, (deadline - (time_t)deadline) * 1e9}};
+
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &when, NULL);
+    next_deadline = deadline;
+}
+
+void remove_job(Job* job) {
+    // Frees a job whose processes have all been reaped, the highest number in use drops past free numbers
+    jobs[job->number - 1] = NULL;
+    num_job_entries--;
+    if (job->deadline && --num_deadlines == 0) {
+        arm_timer(0);
+    }
+    while (highest_job > 0 && jobs[highest_job - 1] == NULL) {
+        highest_job--;
+    }
+    free(job->text);
+    free(job);
+}
+
+Job* find_job(int number) {
+    // Returns job number, or NULL if there is none
+    if (number < 1 || number > highest_job) {
+        return NULL;
+    }
+    return jobs[number - 1];
+}
+
+Job* find_job_spec(char* spec) {
+    /*
+    Returns the job named by spec: %n for job n, % or %+ or NULL for the most recent job, or a pid of one of its
+    processes. Returns NULL if there is no such job.
+    */
+    int i;
+
+    if (spec == NULL || strcmp(spec, "%") == 0 || strcmp(spec, "%+") == 0) {
+        return find_job(highest_job);
+    }
+    if (spec[0] == '%') {
+        return find_job(atoi(spec + 1));
+    }
+
+    i = find_slot(atoi(spec));
+    return i == -1 ? NULL : slots[i].job;
+}
+
+int num_jobs() {
+    return num_job_entries;
+}
+
+double seconds_since(struct timespec* start) {
+    // Monotonic seconds elapsed since start
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+double parse_duration(char* text) {
+    /*
+    Returns the seconds in a duration such as 2, 1.5s, 500ms, or 3m, a number alone is seconds.
+    Returns -1 if text isn't a duration.
+    */
+    char* end;
+    double value;
+
+    if (text == NULL || *text == '\0' || *text == '-') {
+        return -1;
+    }
+    value = strtod(text, &end);
+    if (end == text) {
+        return -1;
+    }
+    if (*end == '\0' || strcmp(end, "s") == 0) {
+        return value;
+    }
+    if (strcmp(end, "ms") == 0) {
+        return value / 1e3;
+    }
+    if (strcmp(end, "m") == 0) {
+        return value * 60;
+    }
+    return -1;
+}
+
+double timeval_seconds(struct timeval* time) {
+    return time->tv_sec + time->tv_usec / 1e6;
+}
+
+void add_usage(Usage* total, struct rusage* usage) {
+    /*
+    Adds the resources used by one process to total. Times and counts are summed, the maximum RSS is the largest.
+    */
+    timeradd(&total->rusage.ru_utime, &usage->ru_utime, &total->rusage.ru_utime);
+    timeradd(&total->rusage.ru_stime, &usage->ru_stime, &total->rusage.ru_stime);
+    if (usage->ru_maxrss > total->rusage.ru_maxrss) {
+        total->rusage.ru_maxrss = usage->ru_maxrss;
+    }
+    total->rusage.ru_minflt += usage->ru_minflt;
+    total->rusage.ru_majflt += usage->ru_majflt;
+    total->rusage.ru_nvcsw += usage->ru_nvcsw;
+    total->rusage.ru_nivcsw += usage->ru_nivcsw;
+}
+
+void print_usage(FILE* stream, Usage* usage) {
+    // Prints the wall-clock time and resources used on one line, without a newline
+    fprintf(stream, "real %.3fs user %.3fs sys %.3fs maxrss %ldkB faults %ld minor %ld major switches %ld voluntary %ld involuntary",
+            usage->wall_seconds, timeval_seconds(&usage->rusage.ru_utime), timeval_seconds(&usage->rusage.ru_stime),
+            usage->rusage.ru_maxrss, usage->rusage.ru_minflt, usage->rusage.ru_majflt,
+            usage->rusage.ru_nvcsw, usage->rusage.ru_nivcsw);
+}
+
+void print_status(int status) {
+    // Prints the exit value or the terminating signal of a process
+    if (WIFEXITED(status)) {
+        printf("exit value %d", WEXITSTATUS(status));
+    }
+    else {
+        printf("terminated by signal %d", WTERMSIG(status));
+    }
+}
+
+void print_job(Job* job) {
+    // Prints the number, state and command line of a job
+    printf("[%d] %-8s %s\n", job->number, job->state == JOB_STOPPED ? "Stopped" : "Running", job->text);
+}
+
+Job* reap_process(pid_t pid, int status, struct rusage* rusage) {
+    /*
+    Records a state change of a process reaped with wait4. A stopped process stops its job, a continued one
+    resumes it. A terminated process is forgotten, and its notice is printed if its job runs in the background.
+    Returns the job if this was its last process, it is freed once the caller is done with it, otherwise NULL.
+    */
+    int i = find_slot(pid);
+
+    if (i == -1) {
+        return NULL;
+    }
+    Job* job = slots[i].job;
+
+    if (WIFSTOPPED(status)) {
+        // a job that stops leaves the foreground
+        if (job->state != JOB_STOPPED) {
+            job->state = JOB_STOPPED;
+            job->is_bg = 1;
+            print_job(job);
+        }
+        return NULL;
+    }
+    if (WIFCONTINUED(status)) {
+        job->state = JOB_RUNNING;
+        return NULL;
+    }
+
+    slots[i].pid = REMOVED_SLOT;
+    slots[i].job = NULL;
+    num_running--;
+    job->num_live--;
+    add_usage(&job->usage, rusage);
+
+    // the status of a job is the status of its last process
+    if (pid == job->pids[job->num_pids - 1]) {
+        job->status = status;
+    }
+
+    if (job->is_bg) {
+        Usage usage = {seconds_since(&job->start), *rusage};
+        printf("background pid %d is done: ", pid);
+        print_status(status);
+        printf(job->timed_out ? " after its timeout (" : " (");
+        print_usage(stdout, &usage);
+        printf(")\n");
+    }
+
+    if (job->num_live == 0) {
+        job->usage.wall_seconds = seconds_since(&job->start);
+        return job;
+    }
+    return NULL;
+}
+
+double monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void set_deadline(int number, double timeout) {
+    /*
+    Kills job number with SIGKILL once timeout seconds have passed since it started. The deadline is kept by
+    timer_fd, which the shell watches wherever it sleeps while a deadline is pending, so no helper process runs.
+    */
+    Job* job = find_job(number);
+
+    job->deadline = job->start.tv_sec + job->start.tv_nsec / 1e9 + timeout;
+    num_deadlines++;
+    if (next_deadline == 0 || job->deadline < next_deadline) {
+        arm_timer(job->deadline);
+    }
+}
+
+void expire_jobs() {
+    // Kills the process group of every job whose deadline has passed and arms the timer for the next deadline
+    uint64_t expirations;
+    double now = monotonic_seconds();
+    double next = 0;
+    int i;
+
+    read(timer_fd, &expirations, sizeof(expirations));
+    for (i = 0; i < highest_job; i++) {
+        Job* job = jobs[i];
+        if (job == NULL || job->deadline == 0) {
+            continue;
+        }
+        if (job->deadline <= now) {
+            COUNTED(SYSCALL_KILL, kill(-job->pgid, SIGKILL));
+            job->timed_out = 1;
+            job->deadline = 0;
+            num_deadlines--;
+        }
+        else if (next == 0 || job->deadline < next) {
+            next = job->deadline;
+        }
+    }
+    arm_timer(next);
+}
+
+int wait_for_fds(struct pollfd* poll_fds, int num_fds) {
+    /*
+    Sleeps until one of poll_fds has an event, a child changes state, or a deadline passes, and kills the jobs
+    whose deadline passed. The first two entries are the shell's own, set here to the SIGCHLD signalfd and the
+    deadline timer. A SIGCHLD read here is left to report_finished_jobs or reap_children through sigchld_seen.
+    Returns 1 if one of the other entries has an event, otherwise returns 0.
+    */
+    struct signalfd_siginfo info;
+    int i;
+
+    poll_fds[0] = (struct pollfd){sigchld_fd, POLLIN, 0};
+    poll_fds[1] = (struct pollfd){timer_fd, POLLIN, 0};
+    if (poll(poll_fds, num_fds, -1) == -1) {
+        return 0;
+    }
+    if (poll_fds[1].revents) {
+        expire_jobs();
+    }
+    if (poll_fds[0].revents && COUNTED(SYSCALL_READ, read(sigchld_fd, &info, sizeof(info))) > 0) {
+        sigchld_seen = 1;
+    }
+    for (i = 2; i < num_fds; i++) {
+        if (poll_fds[i].revents) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int wait_for_event(int fd) {
+    /*
+    Sleeps until fd is readable, if it isn't -1, a child changes state, or a deadline passes, as wait_for_fds.
+    Returns 1 if fd is readable, otherwise returns 0.
+    */
+    struct pollfd poll_fds[3] = {{-1, 0, 0}, {-1, 0, 0}, {fd, POLLIN, 0}};
+
+    return wait_for_fds(poll_fds, fd == -1 ? 2 : 3);
+}
+
+void wait_for_input(int fd) {
+    /*
+    Returns once fd is readable, at once if there are no jobs. Meanwhile the processes of jobs are reaped as they
+    terminate, so their notices give the time they ran rather than the time until the next command was typed,
+    and the deadlines of jobs are kept.
+    */
+    while (num_job_entries > 0 && !wait_for_event(fd)) {
+        report_finished_jobs();
+    }
+}
+
+pid_t wait_child(pid_t pid, int* status, struct rusage* rusage) {
+    /*
+    wait4 for pid, or any child if pid is -1, reporting stopped processes too. While a job has a deadline, or
+    other jobs run beside the one pid belongs to, the shell sleeps in poll() on the SIGCHLD signalfd and the
+    deadline timer instead of in wait4, and the processes of other jobs are reaped as soon as they terminate.
+    Returns the pid that changed state, or -1 if there is no child to wait for.
+    */
+    pid_t changed;
+
+    while (num_deadlines > 0 || (pid != -1 && num_job_entries > 1)) {
+        changed = COUNTED(SYSCALL_WAIT4, wait4(-1, status, WNOHANG | WUNTRACED, rusage));
+        if (changed == 0) {
+            wait_for_event(-1);
+            continue;
+        }
+        if (changed == -1 || pid == -1 || changed == pid) {
+            return changed;
+        }
+
+        // a process of another job, a job done in the background is finished here, others by their waiter
+        Job* done = reap_process(changed, *status, rusage);
+        if (done && done->is_bg) {
+            remove_job(done);
+        }
+    }
+    while ((changed = COUNTED(SYSCALL_WAIT4, wait4(pid, status, WUNTRACED, rusage))) == -1 && errno == EINTR) {
+        ;
+    }
+    return changed;
+}
+
+int wait_for_job(int number, int* status, Usage* usage, int* timed_out) {
+    /*
+    Waits for the processes of job number to terminate or for the job to stop.
+    If it terminated, status and usage are set to the job's, timed_out to 1 if its deadline killed it, and the job
+    is removed.
+    Returns 1 if the job stopped, otherwise returns 0.
+    */
+    Job* job = find_job(number);
+    struct rusage rusage;
+    int process_status;
+    int i;
+
+    for (i = 0; i < job->num_pids && job->num_live > 0; i++) {
+        // skip processes reaped already, by this loop or while waiting for another job
+        if (find_slot(job->pids[i]) == -1) {
+            continue;
+        }
+        // a process that can't be waited for is gone, it is forgotten with no usage and the job's status so far
+        if (wait_child(job->pids[i], &process_status, &rusage) == -1) {
+            memset(&rusage, 0, sizeof(rusage));
+            process_status = job->status;
+        }
+        reap_process(job->pids[i], process_status, &rusage);
+        if (job->state == JOB_STOPPED) {
+            return 1;
+        }
+    }
+
+    *status = job->status;
+    *usage = job->usage;
+    *timed_out = job->timed_out;
+    remove_job(job);
+    return 0;
+}
+
+int wait_for_background(Job* target) {
+    /*
+    Blocks until target terminates, or until no background job is running if target is NULL. Other jobs that
+    terminate meanwhile get their notices. Stopped jobs aren't waited for.
+    Returns the status of target, 0 if target is NULL, or -1 if target stopped.
+    */
+    struct rusage rusage;
+    pid_t pid;
+    int process_status;
+    int number = target ? target->number : 0;
+    int i;
+
+    fflush(stdout);
+    while (1) {
+        // stop once the jobs waited for have terminated or stopped
+        Job* job = find_job(number);
+        if (target && job->state == JOB_STOPPED) {
+            return -1;
+        }
+        if (target == NULL) {
+            for (i = 0; i < highest_job && (jobs[i] == NULL || jobs[i]->state == JOB_STOPPED); i++) {
+                ;
+            }
+            if (i == highest_job) {
+                return 0;
+            }
+        }
+
+        pid = wait_child(-1, &process_status, &rusage);
+        if (pid == -1) {
+            return 0;
+        }
+
+        Job* done = reap_process(pid, process_status, &rusage);
+        fflush(stdout);
+        if (done) {
+            int status = done->status;
+            int was_target = done == target;
+            remove_job(done);
+            if (was_target) {
+                return status;
+            }
+        }
+    }
+}
+
+void continue_job(Job* job, int is_bg) {
+    // Resumes a stopped job in the background or the foreground
+    job->state = JOB_RUNNING;
+    job->is_bg = is_bg;
+    COUNTED(SYSCALL_KILL, kill(-job->pgid, SIGCONT));
+}
+
+void list_jobs() {
+    // Prints every job
+    int i;
+
+    for (i = 0; i < highest_job; i++) {
+        if (jobs[i]) {
+            print_job(jobs[i]);
+        }
+    }
+}
+
+void report_finished_jobs() {
+    /*
+    Reaps every background process that has terminated and prints its exit value or terminating signal,
+    with the time and resources it used, and notes jobs that stopped or continued. The notices are left
+    buffered for the prompt that follows to write them out together.
+    Does nothing unless SIGCHLD arrived since the last call.
+    */
+    struct signalfd_siginfo info;
+    pid_t pid;          // pid of terminated child
+    int status;         // termination status
+    struct rusage rusage;
+
+    // nothing to reap, a SIGCHLD left by a foreground job stays pending until there are jobs again
+    if (num_job_entries == 0 || sigchld_fd == -1) {
+        return;
+    }
+
+    // no child changed state, signals are coalesced so one read drains them all
+    if (!sigchld_seen && COUNTED(SYSCALL_READ, read(sigchld_fd, &info, sizeof(info))) <= 0) {
+        return;
+    }
+    sigchld_seen = 0;
+
+    // reap every child that changed state
+    double start = TRACE_BEGIN();
+    while ((pid = COUNTED(SYSCALL_WAIT4, wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &rusage))) > 0) {
+        Job* done = reap_process(pid, status, &rusage);
+        if (done) {
+            remove_job(done);
+        }
+    }
+    TRACE_END(TRACE_REAP, start, -1);
+}
+
+void reap_children() {
+    /*
+    Reaps every child that changed state once wait_for_fds saw SIGCHLD. As in wait_child, a job done in the
+    background is finished here with its notice left buffered, and the processes of other jobs are left for
+    their waiter to find reaped.
+    */
+    struct rusage rusage;
+    pid_t pid;
+    int status;
+
+    if (!sigchld_seen) {
+        return;
+    }
+    sigchld_seen = 0;
+    while ((pid = COUNTED(SYSCALL_WAIT4, wait4(-1, &status, WNOHANG | WUNTRACED, &rusage))) > 0) {
+        Job* done = reap_process(pid, status, &rusage);
+        if (done && done->is_bg) {
+            remove_job(done);
+        }
+    }
+}
+
+void reap_terminated(int* killed) {
+    /*
+    Reaps every process of a job that has terminated, and prints how each job ended once its last process
+    is reaped. killed[n - 1] is 1 if job n was sent SIGKILL.
+    */
+    struct rusage rusage;
+    pid_t pid;
+    int status;
+
+    while ((pid = COUNTED(SYSCALL_WAIT4, wait4(-1, &status, WNOHANG, &rusage))) > 0) {
+        Job* done = reap_process(pid, status, &rusage);
+        if (done) {
+            printf("[%d] ", done->number);
+            print_status(done->status);
+            printf(killed[done->number - 1] ? " after the timeout (real %.3fs): %s\n" : " (real %.3fs): %s\n",
+                   done->usage.wall_seconds, done->text);
+            remove_job(done);
+        }
+    }
+}
+
+void terminate_jobs(double timeout) {
+    /*
+    Ends every job: SIGTERM is sent to each job's process group, stopped jobs are continued so they receive it,
+    and all of their processes are waited for at once, each one through a pidfd in a single poll(). The jobs
+    still running timeout seconds later are sent SIGKILL. Every process is reaped and a line reports how each
+    job ended, so shutdown takes at most about timeout seconds however many jobs there are.
+    Processes without a pidfd are noticed through the SIGCHLD signalfd instead.
+    */
+    struct signalfd_siginfo info;
+    struct timespec start;
+    struct pollfd* poll_fds = malloc((num_running + 1) * sizeof(struct pollfd));
+    int* killed = calloc(highest_job, sizeof(int));
+    int killed_all = 0;
+    int num_fds = 0;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fflush(stdout);
+    for (i = 0; i < highest_job; i++) {
+        if (jobs[i]) {
+            jobs[i]->is_bg = 0;                         // the summary replaces the per-process notices
+            COUNTED(SYSCALL_KILL, kill(-jobs[i]->pgid, SIGTERM));
+            if (jobs[i]->state == JOB_STOPPED) {
+                COUNTED(SYSCALL_KILL, kill(-jobs[i]->pgid, SIGCONT));
+            }
+        }
+    }
+
+    poll_fds[num_fds].fd = sigchld_fd;
+    poll_fds[num_fds++].events = POLLIN;
+    for (i = 0; i < num_slots; i++) {
+        if (slots[i].pid > 0) {
+            poll_fds[num_fds].fd = syscall(SYS_pidfd_open, slots[i].pid, 0);
+            poll_fds[num_fds].events = POLLIN;
+            num_fds += poll_fds[num_fds].fd != -1;
+        }
+    }
+
+    while (num_running > 0) {
+        reap_terminated(killed);
+        if (num_running == 0) {
+            break;
+        }
+
+        // past the deadline, kill what is left and wait for it without one
+        int timeout_ms = killed_all ? -1 : (timeout - seconds_since(&start)) * 1e3;
+        if (!killed_all && timeout_ms <= 0) {
+            for (i = 0; i < highest_job; i++) {
+                if (jobs[i]) {
+                    killed[i] = 1;
+                    COUNTED(SYSCALL_KILL, kill(-jobs[i]->pgid, SIGKILL));
+                }
+            }
+            killed_all = 1;
+            timeout_ms = -1;
+        }
+
+        if (poll(poll_fds, num_fds, timeout_ms) == -1) {
+            continue;
+        }
+        for (i = 0; i < num_fds; i++) {
+            if (poll_fds[i].revents == 0) {
+                continue;
+            }
+            if (poll_fds[i].fd == sigchld_fd) {
+                // signals are coalesced, one read drains them all
+                COUNTED(SYSCALL_READ, read(sigchld_fd, &info, sizeof(info)));
+            }
+            else {
+                // the process has exited and is reaped by reap_terminated
+                COUNTED(SYSCALL_CLOSE, close(poll_fds[i].fd));
+                poll_fds[i].fd = -1;
+            }
+        }
+    }
+
+    for (i = 1; i < num_fds; i++) {
+        if (poll_fds[i].fd >= 0) {
+            COUNTED(SYSCALL_CLOSE, close(poll_fds[i].fd));
+        }
+    }
+    fflush(stdout);
+    free(poll_fds);
+    free(killed);
+}
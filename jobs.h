@@ -0,0 +1,53 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdio.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/resource.h>
+
+typedef struct Usage {
+    double wall_seconds;        // monotonic time from start until the last process was reaped, as it terminated
+    struct rusage rusage;       // resources used by the processes, see add_usage
+} Usage;
+
+#define JOB_RUNNING 0
+#define JOB_STOPPED 1
+
+typedef struct Job {
+    int number;                 // job number, %n
+    pid_t pgid;                 // process group of the job's processes
+    int state;                  // JOB_RUNNING or JOB_STOPPED
+    int is_bg;                  // 1 == notices are printed when its processes terminate
+    char* text;                 // command line, for jobs
+    struct timespec start;      // when the job was started
+    int num_live;               // processes not reaped yet
+    int status;                 // status of the last process once it terminated
+    double deadline;            // monotonic seconds when timeout kills the job, 0 for none
+    int timed_out;              // 1 == killed at its deadline
+    Usage usage;                // time and resources used by the reaped processes
+    int num_pids;
+    pid_t pids[];               // processes in pipeline order
+} Job;
+
+void jobs_init();
+int add_job(pid_t pgid, pid_t* pids, int num_pids, int is_bg, char* text, struct timespec* start);
+Job* find_job(int number);
+Job* find_job_spec(char* spec);
+int num_jobs();
+void set_deadline(int number, double timeout);
+int wait_for_fds(struct pollfd* poll_fds, int num_fds);
+void wait_for_input(int fd);
+int wait_for_job(int number, int* status, Usage* usage, int* timed_out);
+int wait_for_background(Job* target);
+void continue_job(Job* job, int is_bg);
+void list_jobs();
+void report_finished_jobs();
+void reap_children();
+void terminate_jobs(double timeout);
+double seconds_since(struct timespec* start);
+double parse_duration(char* text);
+void add_usage(Usage* total, struct rusage* usage);
+void print_usage(FILE* stream, Usage* usage);
+
+#endif
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "lexer.h"
+
+#define INITIAL_TOKENS 32           // tokens allocated for a line, doubled as needed
+
+/*
+Single-pass lexer. Every byte of the line is looked at once: words are unquoted in place, so a token's text points
+into the line itself, and the operators (redirections, & | ; && ||) are classified as they are found, with or 
+without spaces around them. Expansion is left for when the command runs, the lexer only records where each
+unquoted $ or ` expansion sits in a word, so words without one are never copied.
+
+Quoting:
+    'text'      everything is literal
+    "text"      everything is literal except $ and ` expansions, and \ before $ ` " \
+    \c          c is literal
+*/
+
+int match_operator(char* c, int* type) {
+    /*
+    Returns the length of the operator starting at c, 0 if there is none, and sets type to its TOKEN_* value.
+    '&' is only an operator when a blank, ';', or the end of the line follows, as in "cmd &" or "cmd&; cmd",
+    or when it starts "&&", "&>", or "&>>".
+    */
+    switch (*c) {
+        case '<':
+            switch (c[1]) {
+                case '<': *type = c[2] == '<' ? TOKEN_HERE_STRING : TOKEN_HERE_DOC; return c[2] == '<' ? 3 : 2;
+                case '>': *type = TOKEN_LESS_GREAT; return 2;
+                case '&': *type = TOKEN_LESS_AMP; return 2;
+                default: *type = TOKEN_LESS; return 1;
+            }
+        case '>':
+            switch (c[1]) {
+                case '>': *type = TOKEN_DGREAT; return 2;
+                case '|': *type = TOKEN_CLOBBER; return 2;
+                case '&': *type = TOKEN_GREAT_AMP; return 2;
+                default: *type = TOKEN_GREAT; return 1;
+            }
+        case '&':
+            if (c[1] == '&') {
+                *type = TOKEN_AND_IF;
+                return 2;
+            }
+            if (c[1] == '>') {
+                *type = c[2] == '>' ? TOKEN_AMP_DGREAT : TOKEN_AMP_GREAT;
+                return c[2] == '>' ? 3 : 2;
+            }
+            *type = TOKEN_AMP;
+            return c[1] == ' ' || c[1] == '\t' || c[1] == ';' || c[1] == '\0';
+        case '|':
+            *type = c[1] == '|' ? TOKEN_OR_IF : TOKEN_PIPE;
+            return c[1] == '|' ? 2 : 1;
+        case ';':
+            *type = TOKEN_SEMI;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int name_length(char* text) {
+    // Returns the length of the variable name text starts with, letters, digits, and '_' not starting with a digit
+    int len = 0;
+
+    if (!(*text == '_' || (*text >= 'a' && *text <= 'z') || (*text >= 'A' && *text <= 'Z'))) {
+        return 0;
+    }
+    while (text[len] == '_' || (text[len] >= 'a' && text[len] <= 'z') || (text[len] >= 'A' && text[len] <= 'Z')
+           || (text[len] >= '0' && text[len] <= '9')) {
+        len++;
+    }
+    return len;
+}
+
+int substitution_length(char* c) {
+    /*
+    Returns the length of the command substitution starting at c, $(...) up to the matching ')' past quoted text 
+    and nested parentheses, or `...` up to the next unescaped '`'. Returns 0 if it isn't closed.
+    */
+    int depth = 0;
+    char* p;
+
+    if (*c == '`') {
+        for (p = c + 1; *p && *p != '`'; p++) {
+            p += *p == '\\' && p[1];
+        }
+        return *p ? p - c + 1 : 0;
+    }
+
+    for (p = c + 1; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        }
+        else if (*p == '\'' || *p == '"') {
+            if ((p = strchr(p + 1, *p)) == NULL) {
+                return 0;
+            }
+        }
+        else if (*p == '(') {
+            depth++;
+        }
+        else if (*p == ')' && --depth == 0) {
+            return p - c + 1;
+        }
+    }
+    return 0;
+}
+
+int expansion_length(char* c) {
+    /*
+    Returns the length of the expansion starting with the '$' or '`' at c, or 0 if it is taken literally:
+    $$, $?, $!, $NAME, ${NAME}, ${NAME:-default}, ${NAME-default}, $(commands), or `commands`.
+    */
+    if (*c == '`' || c[1] == '(') {
+        return substitution_length(c);
+    }
+    if (c[1] == '$' || c[1] == '?' || c[1] == '!') {
+        return 2;
+    }
+    if (name_length(c + 1)) {
+        return 1 + name_length(c + 1);
+    }
+    if (c[1] != '{' || name_length(c + 2) == 0) {
+        return 0;
+    }
+
+    // ${NAME...}: the default runs to the first '}'
+    int len = 2 + name_length(c + 2);
+    if (c[len] == '}') {
+        return len + 1;
+    }
+    if (c[len] == ':' && c[len + 1] == '-') {
+        len += 2;
+    }
+    else if (c[len] == '-') {
+        len++;
+    }
+    else {
+        return 0;
+    }
+    char* close = strchr(c + len, '}');
+    return close ? close - c + 1 : 0;
+}
+
+int is_glob_char(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+int is_io_number(char* text, char* end) {
+    // Checks if the word from text to end is a descriptor number, all digits
+    if (text == end) {
+        return 0;
+    }
+    for (; text < end; text++) {
+        if (*text < '0' || *text > '9') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+typedef struct TokenList {
+    Token* tokens;              // tokens of the line, allocated from arena
+    int num_tokens;
+    int capacity;
+    Arena* arena;
+} TokenList;
+
+Token* next_token(TokenList* list) {
+    // Returns the next free token, doubling the list when it is full
+    if (list->num_tokens == list->capacity) {
+        Token* tokens = arena_alloc(list->arena, list->capacity * 2 * sizeof(Token));
+        memcpy(tokens, list->tokens, list->num_tokens * sizeof(Token));
+        list->tokens = tokens;
+        list->capacity *= 2;
+    }
+    Token* token = &list->tokens[list->num_tokens++];
+    token->text = NULL;
+    token->sites = NULL;
+    token->num_sites = 0;
+    token->is_pattern = 0;
+    return token;
+}
+
+int lex_line(char* line, Token** tokens, Arena* arena) {
+    /*
+    Splits a NUL-terminated line of any length into tokens, modifying the line.
+    tokens is set to an array allocated from arena.
+    Returns the number of tokens, or -1 if the line can't be split (the error is printed).
+    */
+    TokenList list = {arena_alloc(arena, INITIAL_TOKENS * sizeof(Token)), 0, INITIAL_TOKENS, arena};
+    Site* sites = NULL;         // expansions of every word in the line, allocated on the first one
+    int num_sites = 0;
+    int site_len;
+    char* r = line;             // next character to read
+    char* w;                    // where the current word's next character is written, never ahead of r
+
+    while (1) {
+        // skip blanks between tokens
+        while (*r == ' ' || *r == '\t') {
+            r++;
+        }
+        if (*r == '\0') {
+            *tokens = list.tokens;
+            return list.num_tokens;
+        }
+
+        Token* token = next_token(&list);
+
+        // operator
+        int operator_len = match_operator(r, &token->type);
+        if (operator_len) {
+            r += operator_len;
+            continue;
+        }
+
+        // word: unquote in place until an unquoted blank or operator ends it
+        token->type = TOKEN_WORD;
+        token->text = w = r;
+        token->sites = sites ? sites + num_sites : NULL;
+
+        char quote = 0;         // quote character the word is inside of, 0 when unquoted
+        int quoted = 0;         // 1 once a quote or escape was removed from the word
+        int globs = 0;          // 1 once an unquoted glob character is seen, -1 once a quoted one is
+        int type;               // type of the operator that ends the word
+        while (*r != '\0') {
+            char c = *r;
+
+            if (quote == 0 && (c == ' ' || c == '\t' || match_operator(r, &type))) {
+                break;
+            }
+
+            // opening or closing quote
+            if ((quote == 0 && (c == '\'' || c == '"')) || c == quote) {
+                quote = quote ? 0 : c;
+                quoted = 1;
+                r++;
+            }
+            // escaped character, inside double quotes only a few characters can be escaped
+            else if (c == '\\' && quote != '\'' && r[1] != '\0'
+                     && (quote == 0 || r[1] == '$' || r[1] == '`' || r[1] == '"' || r[1] == '\\')) {
+                globs = is_glob_char(r[1]) ? -1 : globs;
+                *w++ = r[1];
+                quoted = 1;
+                r += 2;
+            }
+            // expansion, copied as it is to be expanded when the command runs
+            else if ((c == '$' || c == '`') && quote != '\'' && (site_len = expansion_length(r)) > 0) {
+                if (sites == NULL) {
+                    sites = arena_alloc(arena, (strlen(r) / 2 + 1) * sizeof(Site));
+                    token->sites = sites;
+                }
+                sites[num_sites].offset = w - token->text;
+                sites[num_sites].length = site_len;
+                sites[num_sites++].split = quote == 0 && (c == '`' || r[1] == '(');
+                token->num_sites++;
+                memmove(w, r, site_len);
+                w += site_len;
+                r += site_len;
+            }
+            else {
+                if (is_glob_char(c) && globs != -1) {
+                    globs = quote ? -1 : 1;
+                }
+                *w++ = c;
+                r++;
+            }
+        }
+        token->is_pattern = globs == 1;
+
+        if (quote) {
+            printf("unmatched %c in input\n", quote);
+            fflush(stdout);
+            return -1;
+        }
+
+        // the terminator may overwrite the character that ended the word, it was read already
+        char next = *r;
+        operator_len = match_operator(r, &type);
+
+        // unquoted digits right before a redirection name the descriptor it applies to, as in 2>file
+        if (operator_len && (*r == '<' || *r == '>') && !quoted && is_io_number(token->text, w)) {
+            token->type = TOKEN_IO_NUMBER;
+        }
+        *w = '\0';
+        if (next == '\0') {
+            *tokens = list.tokens;
+            return list.num_tokens;
+        }
+        r += operator_len ? operator_len : 1;
+
+        if (operator_len) {
+            token = next_token(&list);
+            token->type = type;
+        }
+    }
+}
+
+int read_here_documents(Token tokens[], int num_tokens, LineReader read_line, void* source, Arena* arena) {
+    /*
+    Reads the body of every here-document of a lexed line from the lines that follow it, up to the line holding 
+    only the delimiter. The body replaces the delimiter as the text of the word after "<<", with its expansions 
+    recorded like any other word's, so it is expanded and cached with the rest of the line.
+    Returns 0, or -1 if the input ended before a delimiter (the error is printed and the body is kept).
+    */
+    int result = 0;
+    int i;
+
+    for (i = 0; i + 1 < num_tokens; i++) {
+        if (tokens[i].type != TOKEN_HERE_DOC || tokens[i + 1].type != TOKEN_WORD) {
+            continue;
+        }
+
+        Token* body = &tokens[i + 1];
+        char* delimiter = body->text;
+        char* text = NULL;      // body, built with malloc while its length is unknown
+        size_t len = 0;
+        char* line;
+
+        while ((line = read_line(source)) != NULL && strcmp(line, delimiter) != 0) {
+            size_t line_len = strlen(line);
+            text = realloc(text, len + line_len + 2);
+            memcpy(text + len, line, line_len);
+            len += line_len;
+            text[len++] = '\n';
+        }
+        if (line == NULL) {
+            printf("here-document ended by end of input (wanted %s)\n", delimiter);
+            fflush(stdout);
+            result = -1;
+        }
+
+        body->text = arena_alloc(arena, len + 1);
+        if (len > 0) {
+            memcpy(body->text, text, len);
+        }
+        body->text[len] = '\0';
+        free(text);
+
+        // every expansion of the body is expanded, there is no quoting inside it
+        body->num_sites = 0;
+        body->sites = arena_alloc(arena, (len / 2 + 1) * sizeof(Site));
+        char* c = body->text;
+        while ((c = strpbrk(c, "$`")) != NULL) {
+            int site_len = expansion_length(c);
+            if (site_len) {
+                body->sites[body->num_sites].offset = c - body->text;
+                body->sites[body->num_sites].length = site_len;
+                body->sites[body->num_sites++].split = 0;
+            }
+            c += site_len ? site_len : 1;
+        }
+    }
+    return result;
+}
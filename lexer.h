@@ -0,0 +1,45 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#define TOKEN_WORD 0            // argument, command, or filename
+#define TOKEN_LESS 1            // <
+#define TOKEN_GREAT 2           // >
+#define TOKEN_AMP 3             // &
+#define TOKEN_PIPE 4            // |
+#define TOKEN_SEMI 5            // ;
+#define TOKEN_AND_IF 6          // &&
+#define TOKEN_OR_IF 7           // ||
+#define TOKEN_HERE_DOC 8        // <<, the word after it holds the here-document once it is read
+#define TOKEN_HERE_STRING 9     // <<<
+#define TOKEN_DGREAT 10         // >>
+#define TOKEN_CLOBBER 11        // >|
+#define TOKEN_LESS_GREAT 12     // <>
+#define TOKEN_GREAT_AMP 13      // >&
+#define TOKEN_LESS_AMP 14       // <&
+#define TOKEN_AMP_GREAT 15      // &>
+#define TOKEN_AMP_DGREAT 16     // &>>
+#define TOKEN_IO_NUMBER 17      // descriptor number written right before a redirection, as in 2>, text is the number
+
+typedef struct Site {
+    int offset;                 // offset in a word's text of the '$' or '`' starting an expansion
+    int length;                 // length of the expansion's text, as in $$, $NAME, ${NAME:-default}, or $(commands)
+    int split;                  // 1 == unquoted command substitution, its output is split into arguments
+} Site;
+
+typedef struct Token {
+    int type;                   // TOKEN_* value
+    char* text;                 // word with quotes removed or descriptor number, NULL for operators
+    Site* sites;                // unquoted expansions in text, in order
+    int num_sites;              // number of expansions, 0 for words used as they are
+    int is_pattern;             // 1 == word has an unquoted *, ?, or [ and none quoted, expanded to matching paths
+} Token;
+
+// Returns the next line of input without its newline, valid until the next call, or NULL at the end of input
+typedef char* (*LineReader)(void* source);
+
+int name_length(char* text);
+int expansion_length(char* c);
+int lex_line(char* line, Token** tokens, Arena* arena);
+int read_here_documents(Token tokens[], int num_tokens, LineReader read_line, void* source, Arena* arena);
+
+#endif
@@ -0,0 +1,361 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "commands.h"
+#include "spawn.h"
+#include "cmdhash.h"
+#include "jobs.h"
+#include "parallel.h"
+
+#define OUTPUT_CHUNK (64 * 1024)        // bytes copied at a time from a job's grouped output
+#define MAX_PARALLEL_JOBS 256           // most jobs at once, each holds a pidfd and, grouped, a memfd
+
+/*
+parallel runs one command per input argument with at most N of them running at once. Every running job is
+watched through a pidfd, so the shell sleeps in poll() until one of its own children exits. Run in the shell
+itself, it also watches SIGCHLD and the deadline timer meanwhile, so background jobs are reaped and timeouts kept.
+Run in the shell itself, every job is added to the shell's job table, and the running jobs share a process group
+of their own that has the terminal. In a forked pipeline stage or in the background they stay in the process
+group of the stage, whose job the shell already has, so a timeout or the shell's exit ends them with it.
+*/
+
+typedef struct Slot {
+    pid_t pid;                  // job running in the slot, 0 when free
+    int job;                    // number of the job in the shell's job table, 0 if it isn't in it
+    int pidfd;                  // readable once the job has exited, -1 if pidfds aren't available
+    int output_fd;              // memfd holding the job's stdout when grouping, otherwise -1
+    int number;                 // position of the job's argument in the input, from 1
+    char* arg;                  // argument of the job
+    struct timespec start;      // when the job was started
+} Slot;
+
+typedef struct Input {
+    char** list;                // arguments given after :::, NULL when reading lines
+    Reader lines;               // lines of the file or of stdin
+} Input;
+
+char* next_input(Input* input) {
+    // Returns the next argument, or NULL once they are all used. Lines are returned without their newline.
+    int len;
+
+    if (input->list) {
+        return *input->list ? *input->list++ : NULL;
+    }
+    return next_line(&input->lines, &len);
+}
+
+char* substitute(char* word, char* arg) {
+    // Returns a copy of word with every {} replaced by arg
+    size_t arg_len = strlen(arg);
+    size_t len = strlen(word);
+    char* c;
+
+    for (c = strstr(word, "{}"); c; c = strstr(c + 2, "{}")) {
+        len += arg_len - 2;
+    }
+
+    char* result = malloc(len + 1);
+    char* w = result;
+    while ((c = strstr(word, "{}")) != NULL) {
+        memcpy(w, word, c - word);
+        w += c - word;
+        memcpy(w, arg, arg_len);
+        w += arg_len;
+        word = c + 2;
+    }
+    strcpy(w, word);
+    return result;
+}
+
+pid_t start_job(char** template, int num_template, int has_placeholder, Slot* slot, int group, int null_input,
+                pid_t* pgid) {
+    /*
+    Builds the job's command from template and its argument and starts it through the shell's spawn path.
+    The argument replaces every {} in the template, or is appended if the template has none.
+    If pgid isn't NULL the job joins process group *pgid, or leads a new one if it is 0, and is added to the
+    shell's job table.
+    Returns the pid, or -1 if no process could be created.
+    */
+    char** job_args = malloc((num_template + 2) * sizeof(char*));
+    Command cmd;
+    Redirection dev_null = {REDIRECT_INPUT, 0, -1, "/dev/null"};     // stdin when the inputs come from it
+    int num_args = 0;
+    int i;
+
+    for (i = 0; i < num_template; i++) {
+        job_args[num_args++] = substitute(template[i], slot->arg);
+    }
+    if (!has_placeholder) {
+        job_args[num_args++] = strdup(slot->arg);
+    }
+    job_args[num_args] = NULL;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.command = job_args[0];
+    cmd.args = job_args;
+    cmd.redirects = &dev_null;
+    cmd.num_redirects = null_input;
+    cmd.exec_path = hash_lookup(cmd.command);
+
+    // a grouped job writes into its own memfd, copied to stdout once the job is done
+    slot->output_fd = group ? memfd_create("parallel", MFD_CLOEXEC) : -1;
+    clock_gettime(CLOCK_MONOTONIC, &slot->start);
+    slot->pid = spawn_command(&cmd, -1, slot->output_fd, pgid ? *pgid : -1);
+    slot->job = 0;
+    if (slot->pid > 0 && pgid) {
+        *pgid = *pgid ? *pgid : slot->pid;
+        slot->job = add_job(*pgid, &slot->pid, 1, 0, command_text(&cmd), &slot->start);
+    }
+
+    // the child has executed or copied its arguments by now
+    for (i = 0; i < num_args; i++) {
+        free(job_args[i]);
+    }
+    free(job_args);
+
+    slot->pidfd = slot->pid > 0 ? syscall(SYS_pidfd_open, slot->pid, 0) : -1;
+    return slot->pid;
+}
+
+void copy_output(int fd) {
+    // Copies a job's grouped output to stdout in one piece and closes it
+    char* buffer = malloc(OUTPUT_CHUNK);
+    ssize_t num_read;
+
+    lseek(fd, 0, SEEK_SET);
+    while ((num_read = read(fd, buffer, OUTPUT_CHUNK)) > 0) {
+        if (write(STDOUT_FILENO, buffer, num_read) != num_read) {
+            break;
+        }
+    }
+    free(buffer);
+    close(fd);
+}
+
+int finish_job(Slot* slot) {
+    /*
+    Reaps the job in slot, writes its grouped output, and reports its status on stderr.
+    Returns 1 if the job failed, otherwise returns 0.
+    */
+    Usage usage;
+    int timed_out;
+    int status;
+
+    if (slot->job) {
+        wait_for_job(slot->job, &status, &usage, &timed_out);
+    }
+    else {
+        waitpid(slot->pid, &status, 0);
+    }
+    double seconds = seconds_since(&slot->start);
+
+    if (slot->output_fd != -1) {
+        copy_output(slot->output_fd);
+    }
+    if (slot->pidfd != -1) {
+        close(slot->pidfd);
+    }
+
+    if (WIFEXITED(status)) {
+        fprintf(stderr, "job %d is done: exit value %d (real %.3fs): %s\n", slot->number, WEXITSTATUS(status), seconds, slot->arg);
+    }
+    else {
+        fprintf(stderr, "job %d is done: terminated by signal %d (real %.3fs): %s\n", slot->number, WTERMSIG(status), seconds, slot->arg);
+    }
+
+    free(slot->arg);
+    slot->pid = 0;
+    return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int wait_for_slot(Slot* slots, struct pollfd* poll_fds, int num_slots, int in_shell) {
+    /*
+    Sleeps until a running job exits and finishes it. poll_fds has two entries ahead of the slots' pidfds, for
+    the SIGCHLD signalfd and deadline timer that wait_for_fds watches when the jobs run in the shell itself.
+    Returns 1 if the job failed, otherwise returns 0.
+    */
+    struct pollfd* slot_fds = poll_fds + 2;
+    int ready;
+    int i;
+
+    for (i = 0; i < num_slots; i++) {
+        slot_fds[i].fd = slots[i].pid ? slots[i].pidfd : -1;
+        slot_fds[i].events = POLLIN;
+        slot_fds[i].revents = 0;
+
+        // without a pidfd the job can only be waited for directly
+        if (slots[i].pid && slots[i].pidfd == -1) {
+            return finish_job(&slots[i]);
+        }
+    }
+
+    if (in_shell) {
+        // a job's process reaped here is found reaped by wait_for_job, background jobs are finished
+        do {
+            ready = wait_for_fds(poll_fds, num_slots + 2);
+            reap_children();
+        } while (!ready);
+    }
+    else {
+        // the signalfd and timer are the shell's, a forked stage leaves them to it
+        while (poll(slot_fds, num_slots, -1) == -1 && errno == EINTR) {
+            ;
+        }
+    }
+    for (i = 0; i < num_slots; i++) {
+        if (slot_fds[i].revents) {
+            return finish_job(&slots[i]);
+        }
+    }
+    return 0;
+}
+
+int parallel_utility(char** args) {
+    /*
+    parallel [-j N] [-g] [-a file] command [arg ...] [::: input ...]
+    Runs command once per input with at most N jobs at a time, N defaults to the number of online CPUs and is
+    at most MAX_PARALLEL_JOBS.
+    Inputs are the words after :::, otherwise the lines of file (-a) or of stdin. -g writes the output of
+    every job in one piece once it is done instead of as it is produced.
+    Exits with the number of failed jobs, at most 101.
+    */
+    int max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    long num;
+    char* end;
+    int group = 0;
+    char* input_path = NULL;
+    Input input = {NULL, {-1, NULL, 0, 0, 0, 0, NULL}};
+    int in_shell = getpgrp() == shell_pgid;     // 0 in a forked pipeline stage or background process
+    int take_terminal = in_shell;               // the jobs' process group gets the terminal while it runs
+    pid_t job_pgid = 0;                         // process group of the running jobs, 0 while none runs
+    int i = 1;
+
+    // options
+    for (; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        if (strcmp(args[i], "-j") == 0 && args[i + 1]) {
+            num = strtol(args[++i], &end, 10);
+            max_jobs = *end == '\0' && num >= 1 && num <= MAX_PARALLEL_JOBS ? num : 0;
+        }
+        else if (strcmp(args[i], "-g") == 0) {
+            group = 1;
+        }
+        else if (strcmp(args[i], "-a") == 0 && args[i + 1]) {
+            input_path = args[++i];
+        }
+        else {
+            break;
+        }
+    }
+
+    // command template, up to :::
+    char** template = &args[i];
+    int num_template = 0;
+    int has_placeholder = 0;
+    for (; args[i] && strcmp(args[i], ":::") != 0; i++) {
+        has_placeholder |= strstr(args[i], "{}") != NULL;
+        num_template++;
+    }
+
+    if (max_jobs > MAX_PARALLEL_JOBS) {
+        max_jobs = MAX_PARALLEL_JOBS;
+    }
+    if (num_template == 0 || max_jobs < 1) {
+        printf("usage: parallel [-j N] [-g] [-a file] command [arg ...] [::: input ...]\n");
+        return 1;
+    }
+
+    if (args[i]) {
+        input.list = &args[i + 1];
+    }
+    else if (input_path) {
+        input.lines.fd = open(input_path, O_RDONLY | O_CLOEXEC);
+        if (input.lines.fd == -1) {
+            printf("cannot open %s for input\n", input_path);
+            return 1;
+        }
+    }
+    else if (utility_input) {
+        // stdin is the shell's input: the lines after this command are the inputs, starting with those the
+        // shell has buffered, and the terminal, if that is where they are typed, stays with the shell
+        take_pending(&input.lines, utility_input);
+        take_terminal = 0;
+    }
+    else {
+        input.lines.fd = STDIN_FILENO;
+    }
+    int null_input = input.list == NULL && input_path == NULL;
+
+    Slot* slots = calloc(max_jobs, sizeof(Slot));
+    struct pollfd* poll_fds = malloc((max_jobs + 2) * sizeof(struct pollfd));
+    int num_running = 0;
+    int num_started = 0;
+    int num_failed = 0;
+    struct timespec start;
+    char* arg;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fflush(stdout);
+
+    // start a job in every free slot, then start the next one as soon as a slot frees
+    while ((arg = next_input(&input)) != NULL) {
+        if (num_running == max_jobs) {
+            num_failed += wait_for_slot(slots, poll_fds, max_jobs, in_shell);
+            num_running--;
+        }
+
+        // the process group ended with its last job, the next job leads a new one
+        if (num_running == 0) {
+            job_pgid = 0;
+        }
+        for (i = 0; slots[i].pid; i++) {
+            ;
+        }
+
+        slots[i].arg = strdup(arg);
+        slots[i].number = ++num_started;
+        if (start_job(template, num_template, has_placeholder, &slots[i], group, null_input,
+                      in_shell ? &job_pgid : NULL) == -1) {
+            printf("fork() failed!\n");
+            if (slots[i].output_fd != -1) {
+                close(slots[i].output_fd);
+            }
+            free(slots[i].arg);
+            slots[i].pid = 0;
+            num_failed++;
+            break;
+        }
+        if (take_terminal && num_running == 0) {
+            give_terminal(job_pgid);
+        }
+        num_running++;
+    }
+
+    while (num_running > 0) {
+        num_failed += wait_for_slot(slots, poll_fds, max_jobs, in_shell);
+        num_running--;
+    }
+    if (take_terminal) {
+        give_terminal(shell_pgid);
+    }
+
+    fprintf(stderr, "parallel: %d jobs, %d failed, makespan %.3fs with %d slots\n", num_started, num_failed,
+            seconds_since(&start), max_jobs);
+
+    if (input_path) {
+        close(input.lines.fd);
+    }
+    free(input.lines.buffer);
+    free(poll_fds);
+    free(slots);
+    return num_failed > 101 ? 101 : num_failed;
+}
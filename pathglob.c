@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "stats.h"
+#include "pathglob.h"
+
+#define DIRENT_BUFFER_SIZE (256 * 1024)     // bytes of directory entries read per getdents64 call
+#define INITIAL_DIRECTORIES 64              // cache slots allocated at first use, doubled when 3/4 full
+
+#define OP_LITERAL 0            // characters matched as they are
+#define OP_ANY 1                // ?, any one character
+#define OP_STAR 2               // *, any number of characters
+#define OP_CLASS 3              // [...], one character of a set
+
+/*
+Pathname expansion. A pattern is split at '/' into components, and each component with glob characters is compiled
+into a list of match operations once, before any directory is read. Directories are read whole with large
+getdents64 batches into listings, which are cached by path: every pattern of a pipeline shares the listings, or of
+a whole line with set -o dircache, so several patterns over one directory read it once. Components without glob
+characters are looked up directly instead of read.
+*/
+typedef struct PatternOp {
+    int type;                   // OP_* value
+    char* text;                 // OP_LITERAL: characters to match, in the pattern itself
+    int length;                 // OP_LITERAL: number of characters
+    unsigned char* set;         // OP_CLASS: bit set of the 256 bytes matched
+} PatternOp;
+
+typedef struct Component {
+    char* text;                 // component of the pattern, not NUL-terminated
+    int length;
+    PatternOp* ops;             // compiled match operations
+    int num_ops;
+    int is_literal;             // 1 == no glob characters, names one path
+    int is_globstar;            // 1 == **, any number of directories
+} Component;
+
+typedef struct Entry {
+    char* name;
+    int length;
+    unsigned char type;         // DT_* value, DT_UNKNOWN when the file system doesn't report it
+} Entry;
+
+typedef struct Listing {
+    char* path;                 // directory read, "" for the working directory
+    Entry* entries;             // every entry except . and .., empty if the directory can't be read
+    int num_entries;
+} Listing;
+
+typedef struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} LinuxDirent64;
+
+typedef struct PathSearch {
+    Component* components;      // components of the pattern
+    int num_components;
+    int dirs_only;              // 1 == the pattern ends with '/', only directories match
+    char** paths;               // paths matched so far, allocated with malloc
+    int num_paths;
+    int capacity;
+    Arena* arena;               // where paths are built
+} PathSearch;
+
+int dircache = 0;
+
+Arena directory_arena = {NULL};     // listings of the cache, reset when it is forgotten
+Listing** directories = NULL;       // open-addressing cache of listings keyed by path, NULL for an empty slot
+int num_directory_slots = 0;
+int num_directories = 0;
+
+unsigned long hash_path(char* path) {
+    // FNV-1a hash of a directory path
+    unsigned long hash = 14695981039346656037UL;
+
+    for (; *path; path++) {
+        hash = (hash ^ (unsigned char)*path) * 1099511628211UL;
+    }
+    return hash;
+}
+
+Listing** find_directory_slot(char* path) {
+    // Returns the slot holding the listing of path, or the empty slot it would go in
+    unsigned long i = hash_path(path) & (num_directory_slots - 1);
+
+    while (directories[i] != NULL && strcmp(directories[i]->path, path) != 0) {
+        i = (i + 1) & (num_directory_slots - 1);
+    }
+    return &directories[i];
+}
+
+void resize_directories(int new_num_slots) {
+    // Moves every listing to a new table
+    Listing** old_directories = directories;
+    int old_num_slots = num_directory_slots;
+    int i;
+
+    directories = calloc(new_num_slots, sizeof(Listing*));
+    num_directory_slots = new_num_slots;
+
+    for (i = 0; i < old_num_slots; i++) {
+        if (old_directories[i] != NULL) {
+            *find_directory_slot(old_directories[i]->path) = old_directories[i];
+        }
+    }
+    free(old_directories);
+}
+
+Listing* read_directory(char* path) {
+    /*
+    Reads every entry of the directory at path into a listing allocated from the cache's arena.
+    A directory that can't be read has no entries.
+    */
+    static char buffer[DIRENT_BUFFER_SIZE];
+    Listing* listing = arena_alloc(&directory_arena, sizeof(Listing));
+    Entry* entries = NULL;      // grown with realloc while the number of entries is unknown
+    int capacity = 0;
+    long num_bytes;
+    long pos;
+
+    listing->path = arena_strdup(&directory_arena, path);
+    listing->entries = NULL;
+    listing->num_entries = 0;
+
+    int fd = COUNTED(SYSCALL_OPEN, open(*path ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (fd == -1) {
+        return listing;
+    }
+
+    while ((num_bytes = COUNTED(SYSCALL_GETDENTS64, syscall(SYS_getdents64, fd, buffer, sizeof(buffer)))) > 0) {
+        for (pos = 0; pos < num_bytes; pos += ((LinuxDirent64*)(buffer + pos))->d_reclen) {
+            LinuxDirent64* dirent = (LinuxDirent64*)(buffer + pos);
+            char* name = dirent->d_name;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+            if (listing->num_entries == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                entries = realloc(entries, capacity * sizeof(Entry));
+            }
+
+            Entry* entry = &entries[listing->num_entries++];
+            entry->length = strlen(name);
+            entry->name = arena_alloc(&directory_arena, entry->length + 1);
+            memcpy(entry->name, name, entry->length + 1);
+            entry->type = dirent->d_type;
+        }
+    }
+    COUNTED(SYSCALL_CLOSE, close(fd));
+
+    if (listing->num_entries > 0) {
+        listing->entries = arena_alloc(&directory_arena, listing->num_entries * sizeof(Entry));
+        memcpy(listing->entries, entries, listing->num_entries * sizeof(Entry));
+    }
+    free(entries);
+    return listing;
+}
+
+Listing* get_directory(char* path) {
+    // Returns the listing of the directory at path, reading it only if it isn't cached
+    if (directories == NULL) {
+        resize_directories(INITIAL_DIRECTORIES);
+    }
+
+    Listing** slot = find_directory_slot(path);
+    if (*slot == NULL) {
+        if ((num_directories + 1) * 4 > num_directory_slots * 3) {
+            resize_directories(num_directory_slots * 2);
+            slot = find_directory_slot(path);
+        }
+        *slot = read_directory(path);
+        num_directories++;
+    }
+    return *slot;
+}
+
+void forget_directories() {
+    // Empties the cache, the next pattern reads the directories again
+    if (num_directories > 0) {
+        memset(directories, 0, num_directory_slots * sizeof(Listing*));
+        num_directories = 0;
+        arena_reset(&directory_arena);
+    }
+}
+
+int compile_class(char* c, int length, PatternOp* op, Arena* arena) {
+    /*
+    Compiles the bracket expression at c, as in [abc], [a-z], or [!0-9], into op. A ']' right after the '[' or
+    the '!' is part of the set.
+    Returns its length, or 0 if it has no closing ']' and the '[' is an ordinary character.
+    */
+    int negate = length > 1 && (c[1] == '!' || c[1] == '^');
+    int i = 1 + negate;
+    int first = i;
+    int ch;
+
+    op->type = OP_CLASS;
+    op->set = arena_alloc(arena, 32);
+    memset(op->set, 0, 32);
+
+    while (i < length && (c[i] != ']' || i == first)) {
+        unsigned char low = c[i];
+        unsigned char high = low;
+
+        if (i + 2 < length && c[i + 1] == '-' && c[i + 2] != ']') {
+            high = c[i + 2];
+            i += 3;
+        }
+        else {
+            i++;
+        }
+        for (ch = low; ch <= high; ch++) {
+            op->set[ch >> 3] |= 1 << (ch & 7);
+        }
+    }
+    if (i == length) {
+        return 0;
+    }
+
+    if (negate) {
+        for (ch = 0; ch < 32; ch++) {
+            op->set[ch] = ~op->set[ch];
+        }
+    }
+    return i + 1;
+}
+
+void compile_component(Component* comp, char* text, int length, Arena* arena) {
+    // Compiles one component of a pattern, consecutive ordinary characters become one operation
+    PatternOp* ops = arena_alloc(arena, (length + 1) * sizeof(PatternOp));
+    int num_ops = 0;
+    int class_length;
+    int i = 0;
+
+    comp->text = text;
+    comp->length = length;
+    comp->is_globstar = length == 2 && text[0] == '*' && text[1] == '*';
+
+    while (i < length) {
+        if (text[i] == '*') {
+            // ** inside a component is the same as *
+            if (num_ops == 0 || ops[num_ops - 1].type != OP_STAR) {
+                ops[num_ops++].type = OP_STAR;
+            }
+            i++;
+        }
+        else if (text[i] == '?') {
+            ops[num_ops++].type = OP_ANY;
+            i++;
+        }
+        else if (text[i] == '[' && (class_length = compile_class(text + i, length - i, &ops[num_ops], arena))) {
+            num_ops++;
+            i += class_length;
+        }
+        // ordinary characters follow one another in the pattern, so a literal is extended in place
+        else if (num_ops > 0 && ops[num_ops - 1].type == OP_LITERAL) {
+            ops[num_ops - 1].length++;
+            i++;
+        }
+        else {
+            ops[num_ops].type = OP_LITERAL;
+            ops[num_ops].text = text + i;
+            ops[num_ops++].length = 1;
+            i++;
+        }
+    }
+
+    comp->ops = ops;
+    comp->num_ops = num_ops;
+    comp->is_literal = num_ops == 0 || (num_ops == 1 && ops[0].type == OP_LITERAL);
+}
+
+int match_component(Component* comp, Entry* entry) {
+    /*
+    Checks if a directory entry matches a compiled component. A '*' first matches as little as it can, and takes
+    one more character each time the rest fails to match, from the last '*' only.
+    */
+    PatternOp* ops = comp->ops;
+    PatternOp* last = &ops[comp->num_ops - 1];
+    char* s = entry->name;
+    int star = -1;              // operation after the last '*' seen, -1 before any
+    char* star_s = NULL;        // where the characters that '*' didn't take start
+    int i = 0;
+
+    // names starting with '.' are only matched by a pattern that starts with one
+    if (s[0] == '.' && !(ops[0].type == OP_LITERAL && ops[0].text[0] == '.')) {
+        return 0;
+    }
+    // most patterns end with ordinary characters, as in *.log, which rules most names out at once
+    if (last->type == OP_LITERAL && (entry->length < last->length
+                                     || memcmp(s + entry->length - last->length, last->text, last->length) != 0)) {
+        return 0;
+    }
+
+    while (i < comp->num_ops || *s) {
+        if (i < comp->num_ops) {
+            PatternOp* op = &ops[i];
+
+            if (op->type == OP_STAR) {
+                star = ++i;
+                star_s = s;
+                continue;
+            }
+            if (*s && (op->type == OP_ANY
+                       || (op->type == OP_CLASS && (op->set[(unsigned char)*s >> 3] >> (*s & 7) & 1)))) {
+                i++;
+                s++;
+                continue;
+            }
+            if (op->type == OP_LITERAL && strncmp(s, op->text, op->length) == 0) {
+                i++;
+                s += op->length;
+                continue;
+            }
+        }
+
+        // mismatch, the last '*' takes one more character, or the name doesn't match
+        if (star == -1 || *star_s == '\0') {
+            return 0;
+        }
+        s = ++star_s;
+        i = star;
+    }
+    return 1;
+}
+
+char* join_path(char* dir, char* name, int length, Arena* arena) {
+    // Returns dir/name allocated from arena, name alone in the working directory
+    size_t dir_length = strlen(dir);
+    int slash = dir_length > 0 && dir[dir_length - 1] != '/';
+    char* path = arena_alloc(arena, dir_length + slash + length + 1);
+
+    memcpy(path, dir, dir_length);
+    path[dir_length] = '/';
+    memcpy(path + dir_length + slash, name, length);
+    path[dir_length + slash + length] = '\0';
+    return path;
+}
+
+int is_directory(char* path, unsigned char type, int follow) {
+    // Checks if the entry at path is a directory, through symbolic links if follow is 1
+    struct stat info;
+
+    if (type == DT_DIR || (type != DT_UNKNOWN && type != DT_LNK) || (type == DT_LNK && !follow)) {
+        return type == DT_DIR;
+    }
+    return COUNTED(SYSCALL_STAT, fstatat(AT_FDCWD, path, &info, follow ? 0 : AT_SYMLINK_NOFOLLOW)) == 0
+           && S_ISDIR(info.st_mode);
+}
+
+void add_path(PathSearch* search, char* path) {
+    if (search->num_paths == search->capacity) {
+        search->capacity = search->capacity ? search->capacity * 2 : 16;
+        search->paths = realloc(search->paths, search->capacity * sizeof(char*));
+    }
+    search->paths[search->num_paths++] = path;
+}
+
+void add_match(PathSearch* search, char* path, unsigned char type) {
+    // Adds a path the whole pattern matched, a pattern ending with '/' only matches directories
+    if (!search->dirs_only) {
+        add_path(search, path);
+    }
+    else if (is_directory(path, type, 1)) {
+        add_path(search, join_path(path, "", 0, search->arena));
+    }
+}
+
+void search_directory(PathSearch* search, char* dir, int index) {
+    /*
+    Adds the paths in dir that match the components of the pattern from index on.
+    */
+    Component* comp = &search->components[index];
+    int is_last = index == search->num_components - 1;
+    struct stat info;
+    int i;
+
+    // a component without glob characters names one path, which only has to exist
+    if (comp->is_literal) {
+        char* path = join_path(dir, comp->text, comp->length, search->arena);
+
+        if (!is_last) {
+            search_directory(search, path, index + 1);
+        }
+        else if (COUNTED(SYSCALL_STAT, fstatat(AT_FDCWD, path, &info, AT_SYMLINK_NOFOLLOW)) == 0) {
+            add_match(search, path, S_ISLNK(info.st_mode) ? DT_LNK : S_ISDIR(info.st_mode) ? DT_DIR : DT_REG);
+        }
+        return;
+    }
+
+    Listing* listing = get_directory(dir);
+
+    // **: the rest of the pattern in dir itself, then in every directory below it, not following links
+    if (comp->is_globstar) {
+        search_directory(search, dir, index + 1);
+        for (i = 0; i < listing->num_entries; i++) {
+            Entry* entry = &listing->entries[i];
+            char* path;
+
+            if (entry->name[0] != '.'
+                && is_directory(path = join_path(dir, entry->name, entry->length, search->arena), entry->type, 0)) {
+                search_directory(search, path, index);
+            }
+        }
+        return;
+    }
+
+    for (i = 0; i < listing->num_entries; i++) {
+        Entry* entry = &listing->entries[i];
+
+        if (!match_component(comp, entry)) {
+            continue;
+        }
+        char* path = join_path(dir, entry->name, entry->length, search->arena);
+        if (is_last) {
+            add_match(search, path, entry->type);
+        }
+        // only what may be a directory is searched further, the rest would cost an open each
+        else if (entry->type == DT_DIR || entry->type == DT_LNK || entry->type == DT_UNKNOWN) {
+            search_directory(search, path, index + 1);
+        }
+    }
+}
+
+int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char**)a, *(char**)b);
+}
+
+int expand_pattern(char* pattern, char*** paths, Arena* arena) {
+    /*
+    Finds the paths matched by pattern: * matches any characters, ? any one character, [...] one of a set, and a
+    ** component any number of directories. Names starting with '.' are only matched by a '.' written out.
+    Returns the number of paths and sets paths to them, sorted and allocated from arena, or returns 0 if the
+    pattern has no glob characters or matches nothing, the word is then used as it is.
+    */
+    size_t length = strlen(pattern);
+    PathSearch search = {NULL, 0, length > 0 && pattern[length - 1] == '/', NULL, 0, 0, arena};
+    char* start = pattern;
+    int has_glob = 0;
+
+    // at most one component per two characters, and one added after a final **
+    search.components = arena_alloc(arena, (length / 2 + 2) * sizeof(Component));
+    while (*start == '/') {
+        start++;
+    }
+    while (*start) {
+        char* end = strchrnul(start, '/');
+        Component* comp = &search.components[search.num_components++];
+
+        compile_component(comp, start, end - start, arena);
+        has_glob |= !comp->is_literal;
+        for (start = end; *start == '/'; start++) {
+            ;
+        }
+    }
+    if (!has_glob) {
+        return 0;
+    }
+
+    // a final ** matches every file below the directory as well as the directories
+    if (search.components[search.num_components - 1].is_globstar) {
+        compile_component(&search.components[search.num_components++], "*", 1, arena);
+    }
+
+    search_directory(&search, pattern[0] == '/' ? "/" : "", 0);
+    if (search.num_paths > 0) {
+        qsort(search.paths, search.num_paths, sizeof(char*), compare_paths);
+        *paths = arena_alloc(arena, search.num_paths * sizeof(char*));
+        memcpy(*paths, search.paths, search.num_paths * sizeof(char*));
+    }
+    free(search.paths);
+    return search.num_paths;
+}
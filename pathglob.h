@@ -0,0 +1,11 @@
+#ifndef PATHGLOB_H
+#define PATHGLOB_H
+
+#include "arena.h"
+
+extern int dircache;            // 1 == set -o dircache, directory listings are kept for the whole line
+
+int expand_pattern(char* pattern, char*** paths, Arena* arena);
+void forget_directories();
+
+#endif
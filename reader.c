@@ -0,0 +1,118 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "reader.h"
+#include "stats.h"
+
+#define READ_CHUNK (64 * 1024)  // initial buffer size, doubled for a line that doesn't fit
+
+/*
+Lines are read with read() into one buffer, a chunk at a time, and handed out where they are with their newline
+replaced by a terminator, so a chunk of many short lines costs one read and no copies. Only the incomplete line
+at the end of a chunk is moved to the front of the buffer before the next read. A line is valid until the next
+call to next_line.
+*/
+
+int fill_buffer(Reader* reader) {
+    /*
+    Reads the next chunk after the bytes not handed out yet, moving them to the front first, and grows the buffer
+    if they fill it. Returns the number of bytes read, 0 at the end of input.
+    */
+    size_t pending = reader->end - reader->start;
+
+    if (reader->start > 0) {
+        memmove(reader->buffer, reader->buffer + reader->start, pending);
+        reader->start = 0;
+        reader->end = pending;
+    }
+    if (reader->buffer == NULL || reader->end == reader->size) {
+        size_t new_size = reader->size ? reader->size * 2 : READ_CHUNK;
+        char* buffer = realloc(reader->buffer, new_size + 1);
+        if (buffer == NULL) {
+            reader->at_end = 1;
+            return 0;
+        }
+        reader->buffer = buffer;
+        reader->size = new_size;
+    }
+
+    if (reader->wait) {
+        reader->wait(reader->fd);
+    }
+    ssize_t num_read;
+    while ((num_read = COUNTED(SYSCALL_READ, read(reader->fd, reader->buffer + reader->end,
+                                                  reader->size - reader->end))) == -1 && errno == EINTR) {
+        ;
+    }
+    if (num_read <= 0) {
+        reader->at_end = 1;
+        return 0;
+    }
+    reader->end += num_read;
+    return num_read;
+}
+
+int has_line(Reader* reader) {
+    // Checks if a whole line is buffered, so next_line returns it without reading
+    return reader->start < reader->end &&
+           memchr(reader->buffer + reader->start, '\n', reader->end - reader->start) != NULL;
+}
+
+char* next_line(Reader* reader, int* len) {
+    /*
+    Returns the next line without its newline and sets len to its length. A last line without a newline is
+    returned as any other. Returns NULL at the end of input.
+    */
+    size_t searched = reader->start;        // bytes before this hold no newline
+
+    while (1) {
+        char* newline = reader->buffer == NULL ? NULL :
+                        memchr(reader->buffer + searched, '\n', reader->end - searched);
+        if (newline) {
+            char* line = reader->buffer + reader->start;
+            *newline = '\0';
+            *len = newline - line;
+            reader->start = newline + 1 - reader->buffer;
+            return line;
+        }
+
+        // the rest of the input is one line without a newline
+        if (reader->at_end) {
+            if (reader->start == reader->end) {
+                return NULL;
+            }
+            char* line = reader->buffer + reader->start;
+            reader->buffer[reader->end] = '\0';
+            *len = reader->end - reader->start;
+            reader->start = reader->end;
+            return line;
+        }
+
+        // the buffer is moved by fill_buffer, only the new bytes are searched
+        searched = reader->end - reader->start;
+        fill_buffer(reader);
+        searched += reader->start;
+    }
+}
+
+void take_pending(Reader* reader, Reader* from) {
+    /*
+    Moves the bytes read by from but not handed out yet into reader, which must be empty, and reads on from the
+    same descriptor. The lines from handed out already stay where they are, and from has nothing buffered left,
+    so the input isn't read twice.
+    */
+    size_t pending = from->end - from->start;
+
+    reader->fd = from->fd;
+    reader->at_end = from->at_end;
+    if (pending > 0) {
+        reader->buffer = malloc(pending + READ_CHUNK + 1);
+        reader->size = pending + READ_CHUNK;
+        reader->start = 0;
+        reader->end = pending;
+        memcpy(reader->buffer, from->buffer + from->start, pending);
+    }
+    from->start = from->end;
+}
@@ -0,0 +1,20 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+
+typedef struct Reader {
+    int fd;                     // descriptor lines are read from
+    char* buffer;               // chunks read from fd, lines are handed out in place, NULL until the first read
+    size_t size;                // bytes buffer holds, one more is kept for the terminator of a last line
+    size_t start;               // first byte not handed out yet
+    size_t end;                 // bytes read into buffer
+    int at_end;                 // 1 == fd reached the end of input or failed
+    void (*wait)(int fd);       // called before every read to sleep until fd is readable, NULL to just read
+} Reader;
+
+char* next_line(Reader* reader, int* len);
+int has_line(Reader* reader);
+void take_pending(Reader* reader, Reader* from);
+
+#endif
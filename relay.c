@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "commands.h"
+#include "relay.h"
+
+#define RELAY_CHUNK (64 * 1024)         // bytes moved per splice/tee call, the default pipe capacity
+
+int is_relay_stage(Command* cmd) {
+    // Returns 1 if cmd is the shell's relay stage, otherwise returns 0
+    return strcmp(cmd->command, "relay") == 0;
+}
+
+void copy_stream(int tap_fd) {
+    /*
+    Copies stdin to stdout, and to tap_fd if not -1, through a buffer.
+    Used when stdin or stdout isn't a pipe and the kernel can't move the data for us.
+    */
+    char* buffer = malloc(RELAY_CHUNK);
+    ssize_t num_read;
+
+    while ((num_read = read(STDIN_FILENO, buffer, RELAY_CHUNK)) > 0) {
+        if (write(STDOUT_FILENO, buffer, num_read) != num_read) {
+            _exit(1);
+        }
+        if (tap_fd != -1 && write(tap_fd, buffer, num_read) != num_read) {
+            _exit(1);
+        }
+    }
+    _exit(num_read == 0 ? 0 : 1);
+}
+
+void drain_to_file(int tap_fd, ssize_t len) {
+    // Consumes len bytes from stdin into tap_fd, which tee() already duplicated to stdout
+    char buffer[4096];
+    ssize_t moved;
+
+    while (len > 0) {
+        moved = splice(STDIN_FILENO, NULL, tap_fd, NULL, len, SPLICE_F_MOVE);
+
+        // the file doesn't accept splice (e.g. opened for appending), copy this part instead
+        if (moved == -1 && errno == EINVAL) {
+            moved = read(STDIN_FILENO, buffer, len < (ssize_t)sizeof(buffer) ? len : (ssize_t)sizeof(buffer));
+            if (moved > 0 && write(tap_fd, buffer, moved) != moved) {
+                _exit(1);
+            }
+        }
+        if (moved <= 0) {
+            _exit(1);
+        }
+        len -= moved;
+    }
+}
+
+void run_relay(Command* cmd) {
+    /*
+    Relay pipeline stage: relay [-a] [file]
+    Passes stdin through to stdout and, when a file is given, taps a copy of the stream into it.
+    Between pipes the data never enters user space: tee() duplicates it and splice() moves it.
+    Never returns.
+    */
+    int append = cmd->args[1] && strcmp(cmd->args[1], "-a") == 0;
+    char* filename = cmd->args[1 + append];
+    int tap_fd = -1;
+    ssize_t moved;
+
+    if (filename) {
+        tap_fd = open(filename, O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0666);
+        if (tap_fd == -1) {
+            printf("cannot open %s for output\n", filename);
+            fflush(stdout);
+            _exit(1);
+        }
+    }
+
+    while (1) {
+        // duplicate the pending data onto stdout, then move the same bytes into the file
+        if (tap_fd != -1) {
+            moved = tee(STDIN_FILENO, STDOUT_FILENO, RELAY_CHUNK, 0);
+            if (moved > 0) {
+                drain_to_file(tap_fd, moved);
+            }
+        }
+        // move the data straight from stdin to stdout
+        else {
+            moved = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+        }
+
+        // end of the stream
+        if (moved == 0) {
+            _exit(0);
+        }
+        // one of the ends isn't a pipe
+        if (moved == -1 && errno == EINVAL) {
+            copy_stream(tap_fd);
+        }
+        if (moved == -1 && errno != EINTR) {
+            _exit(1);
+        }
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef RELAY_H
+#define RELAY_H
+
+int is_relay_stage(Command* cmd);
+void run_relay(Command* cmd);
+
+#endif
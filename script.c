@@ -0,0 +1,441 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "commands.h"
+#include "script.h"
+
+#define CACHE_MAGIC "SMSC"          // first bytes of every cache file
+#define CACHE_VERSION 8             // bumped whenever the cached token format changes
+
+Arena script_arena = {NULL};        // owns what parsed script commands refer to, for the life of the shell
+
+/*
+A cache file holds a CacheHeader followed by one entry per command line of the script: an int32_t token count
+followed by that many tokens, as lexed from the line before variable expansion. A token is its uint8_t type, and
+for words and descriptor numbers a uint8_t 1 if it is a pattern, an int32_t number of $ and ` expansion sites,
+each an int32_t offset, length, and 1 if its output is split, and the NUL-terminated text. The body of a here-document is the text of the word after its <<, so its lines have no
+entries of their own.
+Scripts with lines the lexer reports errors for aren't cached, so every run prints the errors.
+*/
+typedef struct CacheHeader {
+    char magic[4];
+    int32_t version;
+    int64_t mtime_sec;              // modification time of the script the cache was built from
+    int64_t mtime_nsec;
+    int64_t size;                   // size of that script
+    int32_t num_entries;            // number of entries following the header
+} CacheHeader;
+
+typedef struct Buffer {
+    char* data;
+    size_t len;
+    size_t capacity;
+} Buffer;
+
+void buffer_append(Buffer* buffer, void* data, size_t len) {
+    // Appends len bytes to the buffer, growing it when needed
+    if (buffer->len + len > buffer->capacity) {
+        buffer->capacity = (buffer->len + len) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+void add_command(Command** commands, int* num_commands, int* capacity, Command* cmd) {
+    // Appends cmd to the array of parsed commands
+    if (*num_commands == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *commands = realloc(*commands, *capacity * sizeof(Command));
+    }
+    (*commands)[(*num_commands)++] = *cmd;
+}
+
+void cache_tokens(Buffer* cache, Token tokens[], int num_tokens) {
+    // Appends the cache entry of one line
+    int32_t count = num_tokens;
+    int i;
+
+    buffer_append(cache, &count, sizeof(count));
+    for (i = 0; i < num_tokens; i++) {
+        uint8_t type = tokens[i].type;
+        buffer_append(cache, &type, sizeof(type));
+
+        if (tokens[i].type == TOKEN_WORD || tokens[i].type == TOKEN_IO_NUMBER) {
+            uint8_t is_pattern = tokens[i].is_pattern;
+            int32_t num_sites = tokens[i].num_sites;
+            buffer_append(cache, &is_pattern, sizeof(is_pattern));
+            buffer_append(cache, &num_sites, sizeof(num_sites));
+            buffer_append(cache, tokens[i].sites, num_sites * sizeof(Site));
+            buffer_append(cache, tokens[i].text, strlen(tokens[i].text) + 1);
+        }
+    }
+}
+
+typedef struct ScriptLines {
+    char* next;                     // start of the next line
+    char* end;                      // end of the script text
+} ScriptLines;
+
+char* next_script_line(void* source) {
+    /*
+    LineReader over the text of a script, the newline ending each line is replaced with a NUL.
+    A final line with no newline to terminate it is returned as a copy.
+    */
+    ScriptLines* lines = source;
+    char* line = lines->next;
+
+    if (line >= lines->end) {
+        return NULL;
+    }
+
+    char* newline = memchr(line, '\n', lines->end - line);
+    if (newline) {
+        *newline = '\0';
+        lines->next = newline + 1;
+        return line;
+    }
+
+    int num_chars = lines->end - line;
+    char* last_line = arena_alloc(&script_arena, num_chars + 1);
+    memcpy(last_line, line, num_chars);
+    last_line[num_chars] = '\0';
+    lines->next = lines->end;
+    return last_line;
+}
+
+Command* parse_lines(char* text, size_t text_len, int* num_commands, Buffer* cache) {
+    /*
+    Parses every line of text into an array of Commands. text is modified and must outlive the Commands.
+    Here-documents are read from the lines after the one they are given on.
+    If cache isn't NULL, the tokens of every line are recorded in it, its length is set to 0 if a line had errors.
+    Returns the array, num_commands is set to its length.
+    */
+    Command* commands = NULL;
+    int capacity = 0;
+    Token* tokens;
+    Command* cmd;
+    ScriptLines lines = {text, text + text_len};
+    char* line;
+    int32_t num_entries = 0;
+    int line_errors = 0;            // lines that printed an error
+
+    *num_commands = 0;
+    while ((line = next_script_line(&lines)) != NULL) {
+        // Tokenize the line, check if valid, and add it to the script
+        if (check_line(line, strlen(line))) {
+            int num_tokens = lex_line(line, &tokens, &script_arena);
+
+            if (num_tokens == -1) {
+                line_errors++;
+            }
+            else if (num_tokens > 0) {
+                if (read_here_documents(tokens, num_tokens, next_script_line, &lines, &script_arena) == -1) {
+                    line_errors++;
+                }
+                if (cache) {
+                    cache_tokens(cache, tokens, num_tokens);
+                    num_entries++;
+                }
+                cmd = parse_tokens(tokens, num_tokens, &script_arena);
+                if (cmd) {
+                    add_command(&commands, num_commands, &capacity, cmd);
+                }
+            }
+        }
+    }
+
+    if (cache) {
+        ((CacheHeader*)cache->data)->num_entries = num_entries;
+        if (line_errors) {
+            cache->len = 0;
+        }
+    }
+    return commands;
+}
+
+Command* parse_script_text(char* text, size_t text_len, int* num_commands) {
+    /*
+    Parses a script given as a string (smallsh -c) into an array of Commands.
+    */
+    char* copy = arena_alloc(&script_arena, text_len + 1);
+    memcpy(copy, text, text_len);
+    copy[text_len] = '\0';
+    return parse_lines(copy, text_len, num_commands, NULL);
+}
+
+char* cache_path(char* script_path) {
+    /*
+    Returns the path of the cache file for a script, named after a hash of the script's absolute path.
+    Cache files live in $SMALLSH_CACHE_DIR, or $HOME/.cache/smallsh. Returns NULL if neither is set.
+    */
+    char* dir = getenv("SMALLSH_CACHE_DIR");
+    char* home = getenv("HOME");
+    char resolved[PATH_MAX];
+    char* path;
+    unsigned long hash = 14695981039346656037UL;
+    char* c;
+
+    if (realpath(script_path, resolved) == NULL) {
+        return NULL;
+    }
+    for (c = resolved; *c; c++) {
+        hash = (hash ^ (unsigned char)*c) * 1099511628211UL;
+    }
+
+    if (dir) {
+        path = malloc(strlen(dir) + 32);
+        sprintf(path, "%s/%016lx", dir, hash);
+    }
+    else if (home) {
+        path = malloc(strlen(home) + 48);
+        sprintf(path, "%s/.cache/smallsh/%016lx", home, hash);
+    }
+    else {
+        return NULL;
+    }
+    return path;
+}
+
+void make_parent_dirs(char* path) {
+    // Creates every missing directory leading to path
+    char* slash;
+    for (slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0700);
+        *slash = '/';
+    }
+}
+
+void write_cache(char* path, Buffer* cache) {
+    // Writes the cache file, through a temporary file so readers never see a partial one
+    char* tmp_path = malloc(strlen(path) + 16);
+    int fd;
+
+    // the script had lines with errors
+    if (cache->len == 0 || tmp_path == NULL) {
+        free(tmp_path);
+        return;
+    }
+
+    sprintf(tmp_path, "%s.%d", path, getpid());
+    make_parent_dirs(tmp_path);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd != -1) {
+        if (write(fd, cache->data, cache->len) == (ssize_t)cache->len) {
+            rename(tmp_path, path);
+        }
+        else {
+            unlink(tmp_path);
+        }
+        close(fd);
+    }
+    free(tmp_path);
+}
+
+char* load_token(Token* token, char* entry, char* data_end) {
+    /*
+    Reads the token cached at entry, which the cache file ends before data_end. Its text is used in place, its
+    sites are copied out to be aligned.
+    Returns the entry after it, or NULL if the token doesn't fit in the file or its sites fall outside its text.
+    */
+    int32_t num_sites;
+    int i;
+
+    token->text = NULL;
+    token->sites = NULL;
+    token->num_sites = 0;
+    token->is_pattern = 0;
+    if (entry + sizeof(uint8_t) > data_end) {
+        return NULL;
+    }
+    token->type = *(uint8_t*)entry;
+    entry += sizeof(uint8_t);
+    if (token->type != TOKEN_WORD && token->type != TOKEN_IO_NUMBER) {
+        return entry;
+    }
+
+    if (entry + sizeof(uint8_t) + sizeof(num_sites) > data_end) {
+        return NULL;
+    }
+    token->is_pattern = *(uint8_t*)entry;
+    entry += sizeof(uint8_t);
+    memcpy(&num_sites, entry, sizeof(num_sites));
+    entry += sizeof(num_sites);
+    if (num_sites < 0 || (size_t)num_sites > (data_end - entry) / sizeof(Site)) {
+        return NULL;
+    }
+    if (num_sites > 0) {
+        token->sites = arena_alloc(&script_arena, num_sites * sizeof(Site));
+        memcpy(token->sites, entry, num_sites * sizeof(Site));
+        token->num_sites = num_sites;
+        entry += num_sites * sizeof(Site);
+    }
+
+    // the text must end with its terminator inside the file
+    char* end = memchr(entry, '\0', data_end - entry);
+    if (end == NULL) {
+        return NULL;
+    }
+    token->text = entry;
+    for (i = 0; i < num_sites; i++) {
+        Site* site = &token->sites[i];
+        if (site->offset < 0 || site->length < 0 || site->length > end - entry - site->offset) {
+            return NULL;
+        }
+    }
+    return end + 1;
+}
+
+Command* load_cache(char* path, struct stat* script_info, int* num_commands) {
+    /*
+    Builds the array of Commands from the cache file at path without lexing the script.
+    The file stays mapped for the life of the shell since the Commands refer to it.
+    Returns NULL if there is no cache file, it wasn't built from this version of the script, or it is damaged.
+    */
+    Command* commands = NULL;
+    int capacity = 0;
+    Token* tokens;
+    Command* cmd;
+    struct stat info;
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1) {
+        return NULL;
+    }
+    if (fstat(fd, &info) == -1 || info.st_size < (off_t)sizeof(CacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    char* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+
+    CacheHeader* header = (CacheHeader*)data;
+    char* entry = data + sizeof(CacheHeader);
+    char* data_end = data + info.st_size;
+    int i;
+    int j;
+
+    // cache built from another version of the script, or by another version of the shell
+    if (memcmp(header->magic, CACHE_MAGIC, 4) != 0 || header->version != CACHE_VERSION
+        || header->mtime_sec != script_info->st_mtim.tv_sec || header->mtime_nsec != script_info->st_mtim.tv_nsec
+        || header->size != script_info->st_size) {
+        munmap(data, info.st_size);
+        return NULL;
+    }
+
+    *num_commands = 0;
+    for (i = 0; i < header->num_entries && entry + sizeof(int32_t) <= data_end; i++) {
+        int32_t num_tokens;
+        memcpy(&num_tokens, entry, sizeof(num_tokens));
+        entry += sizeof(num_tokens);
+        if (num_tokens < 0 || num_tokens > data_end - entry) {
+            break;
+        }
+        tokens = arena_alloc(&script_arena, num_tokens * sizeof(Token));
+
+        for (j = 0; j < num_tokens && entry != NULL; j++) {
+            entry = load_token(&tokens[j], entry, data_end);
+        }
+        if (entry == NULL) {
+            break;
+        }
+        cmd = parse_tokens(tokens, j, &script_arena);
+        if (cmd) {
+            add_command(&commands, num_commands, &capacity, cmd);
+        }
+    }
+
+    // a damaged cache file, cut short or written over, is ignored and the script parsed again
+    if (i < header->num_entries) {
+        free(commands);
+        munmap(data, info.st_size);
+        return NULL;
+    }
+
+    // an empty script caches no commands
+    if (commands == NULL) {
+        commands = malloc(sizeof(Command));
+    }
+    return commands;
+}
+
+Command* load_script(char* path, int* num_commands, int* from_cache) {
+    /*
+    Parses the script file at path into an array of Commands.
+    The script is mapped rather than read, and the tokens of every line are cached by the script's modification
+    time so later runs of an unchanged script skip lexing. from_cache is set to 1 if the cache was used.
+    Returns NULL if the script can't be read.
+    */
+    struct stat info;
+    Command* commands;
+    char* cache_file = cache_path(path);
+    int fd = open(path, O_RDONLY);
+
+    *from_cache = 0;
+    if (fd == -1 || fstat(fd, &info) == -1) {
+        free(cache_file);
+        return NULL;
+    }
+
+    // unchanged script parsed before
+    if (cache_file && (commands = load_cache(cache_file, &info, num_commands)) != NULL) {
+        *from_cache = 1;
+        close(fd);
+        free(cache_file);
+        return commands;
+    }
+
+    // empty script
+    if (info.st_size == 0) {
+        close(fd);
+        free(cache_file);
+        *num_commands = 0;
+        return malloc(sizeof(Command));
+    }
+
+    // private writable mapping: splitting the lines only copies the pages it writes to
+    char* text = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+        free(cache_file);
+        return NULL;
+    }
+
+    CacheHeader header;
+    Buffer cache = {NULL, 0, 0};
+    memcpy(header.magic, CACHE_MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.mtime_sec = info.st_mtim.tv_sec;
+    header.mtime_nsec = info.st_mtim.tv_nsec;
+    header.size = info.st_size;
+    header.num_entries = 0;
+    buffer_append(&cache, &header, sizeof(header));
+
+    // the mapping stays for the life of the shell since the Commands refer to it
+    commands = parse_lines(text, info.st_size, num_commands, &cache);
+
+    if (cache_file) {
+        write_cache(cache_file, &cache);
+    }
+    free(cache.data);
+    free(cache_file);
+
+    if (commands == NULL) {
+        commands = malloc(sizeof(Command));
+    }
+    return commands;
+}
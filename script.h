@@ -0,0 +1,7 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+Command* load_script(char* path, int* num_commands, int* from_cache);
+Command* parse_script_text(char* text, size_t text_len, int* num_commands);
+
+#endif
@@ -0,0 +1,170 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "server.h"
+
+#define MAX_EVENTS 64           // epoll events handled per wakeup
+
+/*
+--serve runs one resident shell for many clients. The server accepts connections on a Unix domain socket from an
+epoll loop and forks a session for each one. A session is an ordinary interactive shell whose stdin, stdout and
+stderr are the connection, so its working directory, variables, last status, job table and foreground only mode
+belong to its client alone, and the startup of the shell is paid once by the server instead of once per batch.
+
+A client writes command lines. The session writes back the output of the commands as they run, with no prompt,
+and a status record after every command line: a NUL byte, the status as $? has it, and a newline. When the
+client shuts down its end, or runs exit, the session ends like the shell does at the end of input and writes a
+last record with its exit status before closing the connection.
+*/
+
+int serving = 0;
+
+int listen_on(char* path) {
+    /*
+    Binds a listening socket to path, replacing a socket left there by an earlier server.
+    Returns the socket, or -1 with an error printed.
+    */
+    struct sockaddr_un address = {0};
+    struct stat info;
+    int listen_fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "smallsh: %s: socket path too long\n", path);
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    // only a stale socket is removed, never a regular file given by mistake
+    if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)) {
+        unlink(path);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1 || bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1
+        || listen(listen_fd, SOMAXCONN) == -1) {
+        fprintf(stderr, "smallsh: %s: %s\n", path, strerror(errno));
+        if (listen_fd != -1) {
+            close(listen_fd);
+        }
+        return -1;
+    }
+    return listen_fd;
+}
+
+void reap_sessions() {
+    // Waits for every session that ended, the server has no other children
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+        ;
+    }
+}
+
+void serve(char* path) {
+    /*
+    --serve path: listens on the Unix domain socket path and forks a session for every client that connects.
+    Returns only in a session, with the connection as its stdin, stdout and stderr and the signal mask the shell
+    was started with. The server runs until SIGTERM, SIGINT or SIGHUP, then removes the socket and exits, the
+    sessions keep running until their clients are done.
+    */
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event = {0};
+    struct signalfd_siginfo info;
+    sigset_t server_mask;
+    sigset_t old_mask;
+    int i;
+
+    // SIGCHLD reports sessions that ended, the others stop the server, all of them are read from a signalfd
+    sigemptyset(&server_mask);
+    sigaddset(&server_mask, SIGCHLD);
+    sigaddset(&server_mask, SIGTERM);
+    sigaddset(&server_mask, SIGINT);
+    sigaddset(&server_mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &server_mask, &old_mask);
+
+    int listen_fd = listen_on(path);
+    if (listen_fd == -1) {
+        exit(1);
+    }
+    int signal_fd = signalfd(-1, &server_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.fd = signal_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event);
+
+    while (1) {
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (num_events == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            exit(1);
+        }
+
+        for (i = 0; i < num_events; i++) {
+            if (events[i].data.fd == signal_fd) {
+                while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (info.ssi_signo != SIGCHLD) {
+                        close(listen_fd);
+                        unlink(path);
+                        exit(0);
+                    }
+                }
+                reap_sessions();
+                continue;
+            }
+
+            // accept every pending client, the listening socket is non-blocking
+            while (1) {
+                int connection = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+                if (connection == -1) {
+                    if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED) {
+                        perror("accept4");
+                    }
+                    if (errno != EINTR && errno != ECONNABORTED) {
+                        break;
+                    }
+                    continue;
+                }
+
+                pid_t pid = fork();
+                if (pid == -1) {
+                    perror("fork");
+                }
+                if (pid == 0) {
+                    // the session is a shell of its own, in a new session without the server's terminal
+                    close(epoll_fd);
+                    close(signal_fd);
+                    close(listen_fd);
+                    setsid();
+                    dup2(connection, STDIN_FILENO);
+                    dup2(connection, STDOUT_FILENO);
+                    dup2(connection, STDERR_FILENO);
+                    if (connection > STDERR_FILENO) {
+                        close(connection);
+                    }
+                    sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                    serving = 1;
+                    return;
+                }
+                close(connection);
+            }
+        }
+    }
+}
+
+void send_status(int value) {
+    // Writes the status record of a command line for the client, it goes out with the output before the next read
+    printf("%c%d\n", '\0', value);
+}
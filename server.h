@@ -0,0 +1,9 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+extern int serving;             // 1 == this shell is a --serve session, its stdin, stdout and stderr are a client's connection
+
+void serve(char* path);
+void send_status(int value);
+
+#endif
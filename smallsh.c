@@ -1,34 +1,296 @@
-#define _POSIX_C_SOURCE 200809L
-#include <stdio.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include "commands.h"
-
-#define MAX_PROCESSES 500       // max number of processes allowed
-
-int foreground_mode;                // regular mode == 0, foreground only mode == 1
-
-
-int main(int argc, char* argv[]) {    
-    pid_t shell_pid = getpid();             // shell pid
-    int process_status;                     // process status
-    int num_processes_running = 0;          // number of processes running
-    pid_t processes[MAX_PROCESSES];         // list of running process ids
-
-
-    while(1) {
-        // prompt user, parse input, and initialize a Command struct
-        Command cmd = get_command(shell_pid);
-
-        // command given is a built-in one
-        if (built_in_command(&cmd)) {
-            run_built_in(&cmd, &process_status, num_processes_running, processes);
-        }
-
-        // command given is not built-in
-        else {
-            run_external_command(&cmd, &process_status, processes, &num_processes_running, &foreground_mode);
-        }
-    }
-    return 0;
-}
\ No newline at end of file
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "commands.h"
+#include "script.h"
+#include "jobs.h"
+#include "stats.h"
+#include "vars.h"
+#include "pathglob.h"
+#include "trace.h"
+#include "server.h"
+
+int foreground_mode;                // regular mode == 0, foreground only mode == 1
+Arena expansion_arena = {NULL};     // expanded words of the command running, reset once it has run
+int* last_status;                   // status of the last foreground command, $? of a command substitution
+
+
+double elapsed_us(struct timespec* start) {
+    // Microseconds since start
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+void run_pipeline(Command* cmd, int* process_status) {
+    int i;
+
+    // words are expanded with the status the previous command left
+    set_status_var(*process_status);
+    double start = TRACE_BEGIN();
+    expand_command(cmd, &expansion_arena);
+    TRACE_END(TRACE_EXPAND, start, -1);
+
+    // timeout and limit in front of a command become its settings, a malformed one fails like a command
+    if (take_prefixes(cmd) == -1) {
+        *process_status = W_EXITCODE(1, 0);
+        return;
+    }
+
+    // only assignments, set in the shell itself, the status is left as it was
+    if (cmd->command == NULL) {
+        for (i = 0; i < cmd->num_assigns; i++) {
+            assign(cmd->assigns[i], 0);
+        }
+    }
+
+    // command given is a built-in one
+    else if (built_in_command(cmd)) {
+        start = TRACE_BEGIN();
+        run_built_in(cmd, process_status);
+        TRACE_END(TRACE_BUILT_IN, start, -1);
+    }
+
+    // command given is not built-in
+    else {
+        run_external_command(cmd, process_status, &foreground_mode);
+    }
+}
+
+void run_list(Command* cmd, int* process_status) {
+    /*
+    Runs a list of pipelines and groups in order. After '&&' or '||' the commands that follow are skipped while 
+    the status of the last one run doesn't call for them, a command run in the background counts as succeeding.
+    */
+    while (cmd != NULL && !leaving_substitution) {
+        int succeeded = 1;
+
+        if (cmd->group) {
+            run_list(cmd->group, process_status);
+        }
+        else {
+            run_pipeline(cmd, process_status);
+        }
+        if (!cmd->is_bg) {
+            succeeded = WIFEXITED(*process_status) && WEXITSTATUS(*process_status) == 0;
+        }
+
+        // skip the commands the status rules out, up to one joined by an operator it satisfies
+        int op = cmd->list_op;
+        cmd = cmd->list_next;
+        while (cmd != NULL && ((op == TOKEN_AND_IF && !succeeded) || (op == TOKEN_OR_IF && succeeded))) {
+            op = cmd->list_op;
+            cmd = cmd->list_next;
+        }
+    }
+}
+
+char* command_substitution(char* commands, Arena* arena) {
+    /*
+    Runs the commands of a $(...) or `...` and returns what they wrote to standard output without its trailing 
+    newlines, allocated from arena. Standard output is an anonymous memfd meanwhile, read into arena in one go once
+    the commands are done: the shell waits for every foreground job before it could read a pipe, which would 
+    block the job as soon as it filled. External commands run as jobs like any other, built-ins and utilities 
+    run in the shell without starting a process, so cd or an assignment inside changes the shell itself.
+    */
+    Token* tokens;
+    int status = *last_status;
+    char* output = "";
+
+    int num_tokens = lex_line(commands, &tokens, arena);
+    Command* cmd = num_tokens > 0 ? parse_tokens(tokens, num_tokens, arena) : NULL;
+    if (cmd == NULL) {
+        return output;
+    }
+
+    // what the shell buffered so far belongs to the real stdout
+    flush_output();
+    int capture = COUNTED(SYSCALL_MEMFD_CREATE, memfd_create("substitution", MFD_CLOEXEC));
+    int saved = COUNTED(SYSCALL_DUP, fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10));
+    if (capture == -1 || saved == -1) {
+        printf("command substitution failed: %s\n", commands);
+        fflush(stdout);
+        return output;
+    }
+    COUNTED(SYSCALL_DUP, dup2(capture, STDOUT_FILENO));
+
+    substitution_depth++;
+    run_list(cmd, &status);
+    substitution_depth--;
+    leaving_substitution = 0;
+    flush_output();
+
+    COUNTED(SYSCALL_DUP, dup2(saved, STDOUT_FILENO));
+    COUNTED(SYSCALL_CLOSE, close(saved));
+
+    struct stat info;
+    if (COUNTED(SYSCALL_STAT, fstat(capture, &info)) == 0 && info.st_size > 0) {
+        output = arena_alloc(arena, info.st_size + 1);
+        ssize_t len = COUNTED(SYSCALL_READ, pread(capture, output, info.st_size, 0));
+        len = len < 0 ? 0 : len;
+        while (len > 0 && output[len - 1] == '\n') {
+            len--;
+        }
+        output[len] = '\0';
+    }
+    COUNTED(SYSCALL_CLOSE, close(capture));
+    return output;
+}
+
+void run_command(Command* cmd, int* process_status) {
+    struct timespec start;          // --stats: when the command started
+
+    if (stats_enabled) {
+        stats_reset();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+    }
+
+    last_status = process_status;
+    run_list(cmd, process_status);
+
+    // --stats: the system calls the shell made to run the command
+    if (stats_enabled) {
+        stats_report(stderr, elapsed_us(&start));
+    }
+    arena_reset(&expansion_arena);
+    forget_directories();
+}
+
+void usage() {
+    printf("usage: smallsh [-t] [--stats] [--trace file] [script | -c commands | --serve socket]\n");
+    fflush(stdout);
+    exit(2);
+}
+
+int main(int argc, char* argv[]) {
+    struct timespec start_time;             // shell start, for the -t report
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    pid_t shell_pid;                        // shell pid
+    int process_status = 0;                 // process status
+
+    int report_startup = 0;                 // -t: print the time from startup to the first command
+    char* script_path = NULL;               // script to run instead of prompting
+    char* script_text = NULL;               // -c: commands to run instead of prompting
+    char* serve_path = NULL;                // --serve: socket clients connect to, each gets a session of its own
+    int i;
+
+    for (i = 1; i < argc && script_path == NULL && script_text == NULL; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            report_startup = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            stats_enabled = 1;
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 == argc) {
+                usage();
+            }
+            trace_exit_path = argv[++i];
+            trace_start();
+        }
+        else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 == argc) {
+                usage();
+            }
+            serve_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-c") == 0) {
+            if (i + 1 == argc) {
+                usage();
+            }
+            script_text = argv[++i];
+        }
+        else if (argv[i][0] == '-') {
+            usage();
+        }
+        else {
+            script_path = argv[i];
+        }
+    }
+    if (serve_path && (script_path || script_text)) {
+        usage();
+    }
+
+    // --serve: only sessions return, each one sets itself up below as a shell of its own
+    if (serve_path) {
+        serve(serve_path);
+    }
+
+    // background processes are reaped through a signalfd, signal dispositions are set once for the whole session
+    shell_pid = getpid();
+    jobs_init();
+    init_signals(&foreground_mode);
+    vars_init(shell_pid);
+    run_substitution = command_substitution;
+
+    // non-interactive: parse every command up front, run them without prompting, then exit
+    if (script_path || script_text) {
+        int num_commands;
+        int from_cache = 0;
+        Command* commands;
+
+        // the whole script is one parse event, read from the cache or tokenized
+        double start = TRACE_BEGIN();
+        if (script_path) {
+            commands = load_script(script_path, &num_commands, &from_cache);
+            if (commands == NULL) {
+                printf("cannot open %s for input\n", script_path);
+                fflush(stdout);
+                return 1;
+            }
+        }
+        else {
+            commands = parse_script_text(script_text, strlen(script_text), &num_commands);
+        }
+        TRACE_END(TRACE_PARSE, start, -1);
+
+        for (i = 0; i < num_commands; i++) {
+            if (report_startup && i == 0) {
+                fprintf(stderr, "startup to first exec: %.0f us (%s)\n", elapsed_us(&start_time), from_cache ? "cached" : "parsed");
+            }
+            // report background processes that terminated since the previous command
+            report_finished_jobs();
+            run_command(&commands[i], &process_status);
+        }
+
+        // the script ends like the exit built-in, with the status of its last foreground command
+        exit_cmd(WIFEXITED(process_status) ? WEXITSTATUS(process_status) : 128 + WTERMSIG(process_status), SHUTDOWN_TIMEOUT);
+    }
+
+    Arena line_arena = {NULL};              // owns everything parsed from the current line
+
+    while(1) {
+        // prompt user, parse input, and initialize a Command struct
+        Command* cmd = get_command(&line_arena);
+
+        // the end of input ends the shell like the exit built-in
+        if (cmd == NULL) {
+            exit_cmd(WIFEXITED(process_status) ? WEXITSTATUS(process_status) : 128 + WTERMSIG(process_status), SHUTDOWN_TIMEOUT);
+        }
+
+        if (report_startup) {
+            fprintf(stderr, "startup to first exec: %.0f us\n", elapsed_us(&start_time));
+            report_startup = 0;
+        }
+
+        run_command(cmd, &process_status);
+
+        // --serve: the client learns the line is done from its status record
+        if (serving) {
+            send_status(WIFEXITED(process_status) ? WEXITSTATUS(process_status) : 128 + WTERMSIG(process_status));
+        }
+
+        // the command has run, release the memory of its line
+        arena_reset(&line_arena);
+    }
+    return 0;
+}
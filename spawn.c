@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "commands.h"
+#include "spawn.h"
+#include "relay.h"
+#include "stats.h"
+
+#define SPAWN_STACK_SIZE (64 * 1024)        // stack the vfork child runs on until it execs
+
+// AddressSanitizer can't follow a child running on spawn_stack, sanitized builds start processes with fork()
+#ifdef __SANITIZE_ADDRESS__
+int spawn_mode = SPAWN_FORK;
+#else
+int spawn_mode = SPAWN_VFORK;
+#endif
+int noclobber = 0;
+
+typedef struct SpawnArgs {
+    Command* cmd;           // command to run
+    int in_fd;              // pipe to use as stdin, -1 if none
+    int out_fd;             // pipe to use as stdout, -1 if none
+    pid_t pgid;             // process group to join, 0 to lead a new one, -1 to stay in the shell's
+} SpawnArgs;
+
+static const int limit_resources[NUM_LIMITS] = {RLIMIT_AS, RLIMIT_CPU, RLIMIT_NOFILE};     // by LIMIT_* value
+
+// The parent is suspended while a CLONE_VFORK child runs, so a single stack can be reused by every spawn
+static char spawn_stack[SPAWN_STACK_SIZE] __attribute__((aligned(16)));
+
+static void child_error(const char* format, ...) {
+    /*
+    Prints an error message from the child process.
+    The child shares the parent's memory, so stdio buffers must not be touched: format on the stack and write().
+    */
+    char msg[512];
+    va_list ap;
+
+    va_start(ap, format);
+    int len = vsnprintf(msg, sizeof(msg), format, ap);
+    va_end(ap);
+
+    if (len > (int)sizeof(msg) - 1) {
+        len = sizeof(msg) - 1;
+    }
+    write(STDOUT_FILENO, msg, len);
+}
+
+int open_redirection(Redirection* redirect) {
+    /*
+    Opens the file of a redirection with the flags its type calls for, close-on-exec. It only makes system calls,
+    so a vfork child can use it. With noclobber, > only opens a file that doesn't exist yet or isn't a regular 
+    file, such as /dev/null, and fails with EEXIST otherwise.
+    Returns the descriptor, or -1 with errno set.
+    */
+    char* path = redirect->target;
+    struct stat info;
+    int fd;
+
+    switch (redirect->type) {
+        case REDIRECT_INPUT:
+            return open(path, O_RDONLY | O_CLOEXEC);
+        case REDIRECT_READ_WRITE:
+            return open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        case REDIRECT_APPEND:
+            return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+        case REDIRECT_OUTPUT:
+            if (noclobber) {
+                fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+                if (fd != -1 || errno != EEXIST) {
+                    return fd;
+                }
+                fd = open(path, O_WRONLY | O_CLOEXEC);
+                if (fd != -1 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+                    close(fd);
+                    errno = EEXIST;
+                    return -1;
+                }
+                return fd;
+            }
+            // falls through, without noclobber > truncates like >|
+        default:
+            return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    }
+}
+
+void format_redirect_error(Redirection* redirect, int error, char* msg, size_t size) {
+    // Writes the message for a redirection that failed with errno error to msg, without using stdio buffers
+    if (redirect->type == REDIRECT_DUP) {
+        snprintf(msg, size, "%d: bad file descriptor\n", redirect->source_fd);
+    }
+    else if (redirect->type == REDIRECT_TEXT) {
+        snprintf(msg, size, "cannot create input for here-document\n");
+    }
+    else if (error == EEXIST && redirect->type == REDIRECT_OUTPUT) {
+        snprintf(msg, size, "%s: cannot overwrite existing file\n", redirect->target);
+    }
+    else {
+        snprintf(msg, size, "cannot open %s for %s\n", redirect->target,
+                 redirect->type == REDIRECT_INPUT ? "input" : "output");
+    }
+}
+
+static int redirects_fd(Command* cmd, int fd) {
+    // Checks if one of the command's redirections replaces fd
+    int i;
+
+    for (i = 0; i < cmd->num_redirects; i++) {
+        if (cmd->redirects[i].fd == fd) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void apply_redirection(Redirection* redirect) {
+    /*
+    Applies one redirection in the child, exiting with an error message if it fails.
+    The descriptor of a here-document or here-string was created by the parent.
+    */
+    char msg[512];
+    int fd;
+
+    if (redirect->type == REDIRECT_DUP && redirect->source_fd == -1) {
+        close(redirect->fd);
+        return;
+    }
+
+    if (redirect->type == REDIRECT_DUP) {
+        fd = dup2(redirect->source_fd, redirect->fd);
+    }
+    else {
+        fd = redirect->type == REDIRECT_TEXT ? redirect->source_fd : open_redirection(redirect);
+        if (fd != -1 && fd != redirect->fd) {
+            fd = dup2(fd, redirect->fd) == -1 ? -1 : (close(fd), redirect->fd);
+        }
+        // opened on the descriptor itself, it must stay open across exec
+        else if (fd != -1) {
+            fcntl(fd, F_SETFD, 0);
+        }
+    }
+
+    if (fd == -1) {
+        format_redirect_error(redirect, errno, msg, sizeof(msg));
+        child_error("%s", msg);
+        _exit(1);
+    }
+}
+
+static void redirect_pipe(int fd, int target) {
+    // Moves a pipe end onto stdin or stdout
+    if (fd != -1 && fd != target) {
+        dup2(fd, target);
+        close(fd);
+    }
+}
+
+static void exec_child(SpawnArgs* spawn) {
+    /*
+    Runs in the new child: sets signal dispositions, applies redirections and executes the command.
+    Never returns.
+    */
+
+    Command* cmd = spawn->cmd;
+    int reading = 0;
+    int writing = 1;
+    int i;
+
+    // ignore SIGTSTP signals, foreground processes receive SIGINT while background ones keep ignoring it
+    struct sigaction action = {{0}};
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGTSTP, &action, NULL);
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGTTOU, &action, NULL);
+    if (!cmd->is_bg) {
+        sigaction(SIGINT, &action, NULL);
+    }
+
+    // signals were blocked by the parent around the spawn
+    sigset_t empty_mask;
+    sigemptyset(&empty_mask);
+    sigprocmask(SIG_SETMASK, &empty_mask, NULL);
+
+    if (spawn->pgid != -1) {
+        setpgid(0, spawn->pgid);
+    }
+
+    // pipes to the neighbouring stages come first, redirections given on the command line replace them
+    redirect_pipe(spawn->in_fd, reading);
+    redirect_pipe(spawn->out_fd, writing);
+
+    // background processes default to /dev/null for the stdin and stdout that aren't piped or redirected
+    if (cmd->is_bg && spawn->in_fd == -1 && !redirects_fd(cmd, reading)) {
+        Redirection null_input = {REDIRECT_INPUT, reading, -1, "/dev/null"};
+        apply_redirection(&null_input);
+    }
+    if (cmd->is_bg && spawn->out_fd == -1 && !redirects_fd(cmd, writing)) {
+        Redirection null_output = {REDIRECT_CLOBBER, writing, -1, "/dev/null"};
+        apply_redirection(&null_output);
+    }
+
+    // redirections are applied in the order given, so 2>&1 > file and > file 2>&1 differ as in sh
+    for (i = 0; i < cmd->num_redirects; i++) {
+        apply_redirection(&cmd->redirects[i]);
+    }
+
+    // limit prefix: resource limits of this process, its own and no one else's once it execs
+    for (i = 0; i < NUM_LIMITS; i++) {
+        struct rlimit limit = {cmd->limits[i], cmd->limits[i]};
+        if (cmd->limits[i] && setrlimit(limit_resources[i], &limit) == -1) {
+            child_error("Command '%s' could not be limited: %s\n", cmd->command, strerror(errno));
+            _exit(1);
+        }
+    }
+
+    // relay stages run the shell's own code instead of executing a program
+    if (is_relay_stage(cmd)) {
+        close_range(3, ~0U, 0);
+        run_relay(cmd);
+    }
+
+    // so do utilities, the forked child has a copy of the shell and exits with the utility's exit value
+    if (cmd->utility) {
+        if (cmd->envp) {
+            environ = cmd->envp;
+        }
+        int exit_value = cmd->utility(cmd->args);
+        flush_output();
+        _exit(exit_value);
+    }
+
+    // run command, searching PATH only when the hashed path can't be executed
+    char** envp = cmd->envp ? cmd->envp : environ;
+    if (cmd->exec_path) {
+        execve(cmd->exec_path, cmd->args, envp);
+    }
+    execvpe(cmd->command, cmd->args, envp);
+
+    // command failed since execvp returned, the only limit on arguments is the kernel's ARG_MAX
+    if (errno == E2BIG) {
+        child_error("Command '%s' has an argument list that is too long.\n", cmd->command);
+    }
+    else {
+        child_error("Command '%s' could not be found.\n", cmd->command);
+    }
+    _exit(1);
+}
+
+static int vfork_child(void* arg) {
+    exec_child((SpawnArgs*)arg);
+    return 1;
+}
+
+int open_text_input(char* text) {
+    /*
+    Returns a descriptor to read text from, for a here-document or here-string given as stdin, without going 
+    through the filesystem: the text is written into an anonymous memfd, or a pipe if memfds aren't available and
+    it fits in one. The descriptor is close-on-exec. Returns -1 if it can't be created.
+    */
+    size_t len = strlen(text);
+    int fd = COUNTED(SYSCALL_MEMFD_CREATE, memfd_create("here-document", MFD_CLOEXEC));
+    int pipe_fds[2];
+
+    // written at offset 0 so the reader starts at the beginning without a seek
+    if (fd != -1) {
+        if (COUNTED(SYSCALL_WRITE, pwrite(fd, text, len, 0)) != (ssize_t)len) {
+            COUNTED(SYSCALL_CLOSE, close(fd));
+            return -1;
+        }
+        return fd;
+    }
+
+    // a write of at most PIPE_BUF to an empty pipe never blocks
+    if (len > PIPE_BUF || COUNTED(SYSCALL_PIPE2, pipe2(pipe_fds, O_CLOEXEC)) == -1) {
+        return -1;
+    }
+    COUNTED(SYSCALL_WRITE, write(pipe_fds[1], text, len));
+    COUNTED(SYSCALL_CLOSE, close(pipe_fds[1]));
+    return pipe_fds[0];
+}
+
+pid_t spawn_command(Command* cmd, int in_fd, int out_fd, pid_t pgid) {
+    /*
+    Starts cmd in a new child process with in_fd and out_fd, if not -1, as its stdin and stdout.
+    The text of every here-document or here-string is written out before the child starts.
+    The child joins process group pgid: 0 makes it the leader of a new group, -1 keeps the shell's group.
+    Returns the child pid, or -1 if no process could be created.
+    */
+
+    SpawnArgs spawn = {cmd, in_fd, out_fd, pgid};
+    // relay stages and utilities keep running shell code, they can't share memory
+    int mode = is_relay_stage(cmd) || cmd->utility ? SPAWN_FORK : spawn_mode;
+    pid_t spawn_pid = -1;
+    char* stack = spawn_stack;
+    size_t stack_size = SPAWN_STACK_SIZE;
+    int num_args = 0;
+    sigset_t all_signals;
+    sigset_t old_mask;
+    int i;
+
+    /*
+    execvpe copies the arguments onto the stack to run a file without #! through /bin/sh, so a long argument
+    list gets a stack of its own that fits them, mapped for this spawn only.
+    */
+    for (; mode == SPAWN_VFORK && cmd->args[num_args]; num_args++) {
+        ;
+    }
+    if ((num_args + 2) * sizeof(char*) > SPAWN_STACK_SIZE / 2) {
+        stack_size += (num_args + 2) * sizeof(char*);
+        stack = COUNTED(SYSCALL_MMAP, mmap(NULL, stack_size, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0));
+        if (stack == MAP_FAILED) {
+            stack = NULL;
+            mode = SPAWN_FORK;
+        }
+    }
+
+    // here-documents and here-strings are written out by the shell, the child only moves them into place
+    for (i = 0; i < cmd->num_redirects; i++) {
+        if (cmd->redirects[i].type == REDIRECT_TEXT) {
+            cmd->redirects[i].source_fd = open_text_input(cmd->redirects[i].target);
+        }
+    }
+
+    // no handler of the shell may run in the child while it shares the shell's memory
+    sigfillset(&all_signals);
+    COUNTED(SYSCALL_SIGPROCMASK, sigprocmask(SIG_BLOCK, &all_signals, &old_mask));
+
+    if (mode == SPAWN_VFORK) {
+        spawn_pid = COUNTED(SYSCALL_CLONE, clone(vfork_child, stack + stack_size, CLONE_VM | CLONE_VFORK | SIGCHLD, &spawn));
+
+        // clone is not permitted here, use fork from now on
+        if (spawn_pid == -1 && (errno == ENOSYS || errno == EINVAL || errno == EPERM)) {
+            spawn_mode = mode = SPAWN_FORK;
+        }
+    }
+
+    if (mode == SPAWN_FORK) {
+        spawn_pid = COUNTED(SYSCALL_FORK, fork());
+        if (spawn_pid == 0) {
+            exec_child(&spawn);
+        }
+    }
+
+    // the vfork child has executed or exited, its stack is free again
+    if (stack != spawn_stack && stack != NULL) {
+        COUNTED(SYSCALL_MUNMAP, munmap(stack, stack_size));
+    }
+
+    // set the group from both sides so it exists before either process relies on it
+    if (spawn_pid > 0 && pgid != -1) {
+        COUNTED(SYSCALL_SETPGID, setpgid(spawn_pid, pgid ? pgid : spawn_pid));
+    }
+
+    COUNTED(SYSCALL_SIGPROCMASK, sigprocmask(SIG_SETMASK, &old_mask, NULL));
+
+    // the child has its own copies of the text descriptors
+    for (i = 0; i < cmd->num_redirects; i++) {
+        if (cmd->redirects[i].type == REDIRECT_TEXT && cmd->redirects[i].source_fd != -1) {
+            COUNTED(SYSCALL_CLOSE, close(cmd->redirects[i].source_fd));
+        }
+    }
+    return spawn_pid;
+}
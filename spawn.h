@@ -0,0 +1,15 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#define SPAWN_VFORK 0           // clone(CLONE_VM | CLONE_VFORK): no page table copy, parent sleeps until exec
+#define SPAWN_FORK 1            // plain fork(): fallback when clone is unavailable
+
+extern int spawn_mode;          // engine used by spawn_command
+extern int noclobber;           // 1 == set -C, > doesn't overwrite existing files
+
+pid_t spawn_command(Command* cmd, int in_fd, int out_fd, pid_t pgid);
+int open_text_input(char* text);
+int open_redirection(Redirection* redirect);
+void format_redirect_error(Redirection* redirect, int error, char* msg, size_t size);
+
+#endif
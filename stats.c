@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <time.h>
+#include "stats.h"
+
+int stats_enabled = 0;
+
+char* syscall_names[NUM_SYSCALLS] = {
+    "clone", "fork", "wait4", "setpgid", "sigprocmask", "tcsetpgrp", "pipe2", "close", "read", "write", "open",
+    "dup", "kill", "memfd_create", "getdents64", "stat", "access", "getrusage", "chdir", "mmap",
+    "munmap"
+};
+long syscall_counts[NUM_SYSCALLS];
+double syscall_us[NUM_SYSCALLS];        // time spent in each call since the last reset
+
+static double clock_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+double stats_start() {
+    // Start time of a counted call, reading the clock only when --stats is on
+    return stats_enabled ? clock_us() : 0;
+}
+
+void stats_stop(int id, double start) {
+    if (stats_enabled) {
+        syscall_counts[id]++;
+        syscall_us[id] += clock_us() - start;
+    }
+}
+
+void flush_output() {
+    /*
+    Writes out what is buffered on stdout, counting the write. Output is batched and only flushed before the shell
+    blocks or a child could write to the same stdout.
+    */
+    if (__fpending(stdout) > 0) {
+        COUNTED(SYSCALL_WRITE, fflush(stdout));
+    }
+}
+
+void stats_reset() {
+    int i;
+
+    for (i = 0; i < NUM_SYSCALLS; i++) {
+        syscall_counts[i] = 0;
+        syscall_us[i] = 0;
+    }
+}
+
+void stats_report(FILE* stream, double command_us) {
+    /*
+    Prints the calls counted since the last reset, with their number and time, and the time the command took.
+    */
+    long total = 0;
+    double total_us = 0;
+    int i;
+
+    for (i = 0; i < NUM_SYSCALLS; i++) {
+        total += syscall_counts[i];
+        total_us += syscall_us[i];
+    }
+
+    fprintf(stream, "stats: %ld syscalls %.0f us, command %.0f us:", total, total_us, command_us);
+    for (i = 0; i < NUM_SYSCALLS; i++) {
+        if (syscall_counts[i]) {
+            fprintf(stream, " %s %ld (%.0f us)", syscall_names[i], syscall_counts[i], syscall_us[i]);
+        }
+    }
+    fprintf(stream, "\n");
+}
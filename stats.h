@@ -0,0 +1,48 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+// system calls made by the shell itself on the launch path and for pathname expansion, counted by --stats
+#define SYSCALL_CLONE 0
+#define SYSCALL_FORK 1
+#define SYSCALL_WAIT4 2
+#define SYSCALL_SETPGID 3
+#define SYSCALL_SIGPROCMASK 4
+#define SYSCALL_TCSETPGRP 5
+#define SYSCALL_PIPE2 6
+#define SYSCALL_CLOSE 7
+#define SYSCALL_READ 8
+#define SYSCALL_WRITE 9
+#define SYSCALL_OPEN 10
+#define SYSCALL_DUP 11
+#define SYSCALL_KILL 12
+#define SYSCALL_MEMFD_CREATE 13
+#define SYSCALL_GETDENTS64 14
+#define SYSCALL_STAT 15
+#define SYSCALL_ACCESS 16
+#define SYSCALL_GETRUSAGE 17
+#define SYSCALL_CHDIR 18
+#define SYSCALL_MMAP 19
+#define SYSCALL_MUNMAP 20
+#define NUM_SYSCALLS 21
+
+extern int stats_enabled;       // 1 == --stats, count and time the calls made through COUNTED
+
+/*
+Runs a system call, counting it and timing it when --stats is on. Only the shell's own calls go through here,
+never those of a child sharing its memory before exec.
+*/
+#define COUNTED(id, call) ({                        \
+    double counted_start = stats_start();           \
+    __typeof__(call) counted_result = (call);       \
+    stats_stop(id, counted_start);                  \
+    counted_result; })
+
+double stats_start();
+void stats_stop(int id, double start);
+void flush_output();
+void stats_reset();
+void stats_report(FILE* stream, double command_us);
+
+#endif
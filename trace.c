@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+#define TRACE_EVENTS 65536      // events kept, a power of two, the oldest are overwritten once it is full
+#define NUM_BUCKETS 32          // histogram buckets, bucket b > 0 counts durations in [2^(b-1), 2^b) us
+#define BAR_WIDTH 40            // characters of the largest histogram bar
+
+/*
+Tracing records one fixed-size event per stage of running a command into a ring buffer allocated by the first
+trace start, so recording is a clock read and a store, and never allocates. Every event also goes into a log2
+histogram of its stage, which keeps counting after the ring has wrapped. trace dump writes the events kept in
+Chrome's trace event format, for chrome://tracing or Perfetto.
+*/
+typedef struct TraceEvent {
+    double start;               // monotonic microseconds
+    double duration;            // microseconds
+    int stage;                  // TRACE_* value
+    int arg;                    // pid shown with the event, -1 for none
+} TraceEvent;
+
+typedef struct Histogram {
+    long count;
+    double total_us;
+    double max_us;
+    long buckets[NUM_BUCKETS];
+} Histogram;
+
+int trace_enabled = 0;
+char* trace_exit_path = NULL;
+
+char* stage_names[NUM_TRACE_STAGES] = {"parse", "expand", "built-in", "spawn", "wait", "reap"};
+TraceEvent* events = NULL;      // ring of TRACE_EVENTS events, allocated by the first trace start
+long num_events = 0;            // events recorded since trace start, the last TRACE_EVENTS are kept
+Histogram histograms[NUM_TRACE_STAGES];
+
+double trace_clock_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e6 + now.tv_nsec / 1e3;
+}
+
+int bucket_of(double us) {
+    // Histogram bucket of a duration: 0 below 1 us, otherwise 1 + floor(log2(us)), the last bucket takes the rest
+    if (us < 1) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll((unsigned long long)us);
+    return bucket < NUM_BUCKETS ? bucket : NUM_BUCKETS - 1;
+}
+
+void trace_record(int stage, double start, int arg) {
+    // Records a stage that began at start and ends now, through TRACE_END
+    double duration = trace_clock_us() - start;
+    TraceEvent* event = &events[num_events++ & (TRACE_EVENTS - 1)];
+    Histogram* histogram = &histograms[stage];
+
+    event->start = start;
+    event->duration = duration;
+    event->stage = stage;
+    event->arg = arg;
+
+    histogram->count++;
+    histogram->total_us += duration;
+    if (duration > histogram->max_us) {
+        histogram->max_us = duration;
+    }
+    histogram->buckets[bucket_of(duration)]++;
+}
+
+void trace_start() {
+    // Turns tracing on, forgetting the events and histograms of an earlier trace
+    if (events == NULL) {
+        events = malloc(TRACE_EVENTS * sizeof(TraceEvent));
+        if (events == NULL) {
+            return;
+        }
+    }
+    num_events = 0;
+    memset(histograms, 0, sizeof(histograms));
+    trace_enabled = 1;
+}
+
+int trace_write(char* path) {
+    /*
+    Writes the events kept to path as Chrome trace event JSON, one complete event per stage.
+    Returns 0 on success or -1 with errno set if the file can't be written.
+    */
+    FILE* file = fopen(path, "w");
+    long first = num_events > TRACE_EVENTS ? num_events - TRACE_EVENTS : 0;
+    int pid = getpid();
+    long i;
+
+    if (file == NULL) {
+        return -1;
+    }
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"smallsh\"}}", pid, pid);
+    for (i = first; i < num_events; i++) {
+        TraceEvent* event = &events[i & (TRACE_EVENTS - 1)];
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"smallsh\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                stage_names[event->stage], event->start, event->duration, pid, pid);
+        if (event->arg != -1) {
+            fprintf(file, ",\"args\":{\"pid\":%d}", event->arg);
+        }
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+int trace_utility(char** args) {
+    /*
+    trace start|stop|dump file: starts recording the stages of every command, stops, or writes the events kept
+    to file as Chrome trace event JSON. With no arguments prints whether tracing is on.
+    Exits with 1 on a usage error or if file can't be written, otherwise 0.
+    */
+    if (args[1] == NULL) {
+        printf("trace: %s, %ld events\n", trace_enabled ? "on" : "off", num_events);
+    }
+    else if (strcmp(args[1], "start") == 0 && args[2] == NULL) {
+        trace_start();
+    }
+    else if (strcmp(args[1], "stop") == 0 && args[2] == NULL) {
+        trace_enabled = 0;
+    }
+    else if (strcmp(args[1], "dump") == 0 && args[2] && args[3] == NULL) {
+        if (trace_write(args[2]) == -1) {
+            printf("trace: %s: %s\n", args[2], strerror(errno));
+            return 1;
+        }
+    }
+    else {
+        printf("usage: trace start|stop|dump file\n");
+        return 1;
+    }
+    return 0;
+}
+
+double bucket_limit(int bucket) {
+    // Upper bound in microseconds of the durations in bucket
+    return (double)(1ULL << bucket);
+}
+
+double percentile(Histogram* histogram, double fraction) {
+    // Upper bound of the bucket holding the given fraction of the durations
+    long rank = fraction * histogram->count + 0.5;
+    long seen = 0;
+    int i;
+
+    for (i = 0; i < NUM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank && seen > 0) {
+            return bucket_limit(i);
+        }
+    }
+    return bucket_limit(NUM_BUCKETS - 1);
+}
+
+int stats_utility(char** args) {
+    /*
+    stats: prints a latency histogram of every stage recorded since trace start, with the number of events, the
+    mean and maximum, and p50 and p99 as the upper bounds of their buckets.
+    */
+    char range[32];
+    int stage;
+    int i;
+
+    if (num_events == 0) {
+        printf("stats: no events, trace start records them\n");
+        return 0;
+    }
+    for (stage = 0; stage < NUM_TRACE_STAGES; stage++) {
+        Histogram* histogram = &histograms[stage];
+        long most = 0;
+
+        if (histogram->count == 0) {
+            continue;
+        }
+        printf("%s: %ld events, mean %.1f us, p50 < %.0f us, p99 < %.0f us, max %.1f us\n", stage_names[stage],
+               histogram->count, histogram->total_us / histogram->count, percentile(histogram, 0.5),
+               percentile(histogram, 0.99), histogram->max_us);
+
+        for (i = 0; i < NUM_BUCKETS; i++) {
+            if (histogram->buckets[i] > most) {
+                most = histogram->buckets[i];
+            }
+        }
+        for (i = 0; i < NUM_BUCKETS; i++) {
+            if (histogram->buckets[i] == 0) {
+                continue;
+            }
+            int width = BAR_WIDTH * histogram->buckets[i] / most;
+            snprintf(range, sizeof(range), "[%.0f, %.0f) us", i ? bucket_limit(i - 1) : 0, bucket_limit(i));
+            printf("    %-26s %8ld %.*s\n", range, histogram->buckets[i], width ? width : 1,
+                   "########################################");
+        }
+    }
+    return 0;
+}
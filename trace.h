@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// stages of running a command line, traced by trace start
+#define TRACE_PARSE 0           // lexing and parsing a line, or a whole script before it runs
+#define TRACE_EXPAND 1          // expanding the words of a pipeline
+#define TRACE_BUILT_IN 2        // running a built-in or utility inside the shell
+#define TRACE_SPAWN 3           // starting one process, fork or clone up to exec
+#define TRACE_WAIT 4            // waiting for a foreground job to terminate or stop
+#define TRACE_REAP 5            // reaping background processes that terminated
+#define NUM_TRACE_STAGES 6
+
+extern int trace_enabled;       // 1 == trace start, stages are recorded until trace stop
+extern char* trace_exit_path;   // --trace file: trace from startup and write the events to file on exit
+
+/*
+Marks the start and end of a stage. When tracing is off neither reads the clock nor calls into trace.c, so the
+points cost one test of trace_enabled. A stage that began while tracing was off, as trace start itself does, has
+a start of 0 and isn't recorded. arg is shown with the event, a pid or -1.
+*/
+#define TRACE_BEGIN() (trace_enabled ? trace_clock_us() : 0)
+#define TRACE_END(stage, start, arg) do {           \
+    if (trace_enabled && (start) > 0) {             \
+        trace_record(stage, start, arg);            \
+    }                                               \
+} while (0)
+
+double trace_clock_us();
+void trace_record(int stage, double start, int arg);
+void trace_start();
+int trace_write(char* path);
+int trace_utility(char** args);
+int stats_utility(char** args);
+
+#endif
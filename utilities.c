@@ -0,0 +1,466 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utilities.h"
+
+#define SPEC_SIZE 64            // longest printf conversion specification kept, with room for a length modifier
+
+char* put_escape(char* s, int in_format, int* stop) {
+    /*
+    Writes the character of the backslash escape starting after the backslash at s.
+    Octal escapes are \nnn in a printf format, and \0nnn for echo and %b.
+    stop is set to 1 by \c, which ends all output. Returns the first character after the escape.
+    */
+    int value = 0;
+    int digits = 0;
+
+    switch (*s) {
+        case 'a': putchar('\a'); return s + 1;
+        case 'b': putchar('\b'); return s + 1;
+        case 'e': putchar('\033'); return s + 1;
+        case 'f': putchar('\f'); return s + 1;
+        case 'n': putchar('\n'); return s + 1;
+        case 'r': putchar('\r'); return s + 1;
+        case 't': putchar('\t'); return s + 1;
+        case 'v': putchar('\v'); return s + 1;
+        case '\\': putchar('\\'); return s + 1;
+        case 'c':
+            *stop = 1;
+            return s + 1;
+    }
+
+    // octal value, up to 3 digits
+    if (*s >= '0' && *s <= '7') {
+        if (!in_format && *s == '0') {
+            s++;
+        }
+        while (digits < 3 && *s >= '0' && *s <= '7') {
+            value = value * 8 + (*s++ - '0');
+            digits++;
+        }
+        putchar(value);
+        return s;
+    }
+
+    // not an escape, the backslash is kept
+    putchar('\\');
+    return s;
+}
+
+int put_escaped(char* s) {
+    // Writes s with its backslash escapes interpreted, returns 1 if \c stopped the output
+    int stop = 0;
+
+    while (*s && !stop) {
+        if (*s == '\\' && s[1]) {
+            s = put_escape(s + 1, 0, &stop);
+        }
+        else {
+            putchar(*s++);
+        }
+    }
+    return stop;
+}
+
+int echo_utility(char** args) {
+    /*
+    Writes its arguments separated by spaces and followed by a newline.
+    -n leaves out the newline, -e interprets backslash escapes and -E, the default, doesn't.
+    */
+    int newline = 1;
+    int escapes = 0;
+    int i;
+    char* c;
+
+    // options are only recognized before the first argument that isn't one
+    for (i = 1; args[i] && args[i][0] == '-' && args[i][1]; i++) {
+        for (c = args[i] + 1; *c == 'n' || *c == 'e' || *c == 'E'; c++);
+        if (*c) {
+            break;
+        }
+        for (c = args[i] + 1; *c; c++) {
+            if (*c == 'n') {
+                newline = 0;
+            }
+            else {
+                escapes = *c == 'e';
+            }
+        }
+    }
+
+    for (; args[i]; i++) {
+        if (escapes) {
+            if (put_escaped(args[i])) {
+                return 0;
+            }
+        }
+        else {
+            fputs(args[i], stdout);
+        }
+        if (args[i + 1]) {
+            putchar(' ');
+        }
+    }
+    if (newline) {
+        putchar('\n');
+    }
+    return 0;
+}
+
+int true_utility(char** args) {
+    return 0;
+}
+
+int false_utility(char** args) {
+    return 1;
+}
+
+int pwd_utility(char** args) {
+    // Writes the current directory
+    char* cwd = getcwd(NULL, 0);
+
+    if (cwd == NULL) {
+        printf("pwd: cannot get current directory\n");
+        return 1;
+    }
+    puts(cwd);
+    free(cwd);
+    return 0;
+}
+
+int printf_number(char* arg, long long* value) {
+    /*
+    Converts a printf argument to a number, a leading quote gives the value of the character after it.
+    Returns 1 if arg is a valid number, otherwise prints an error and returns 0, value is what could be converted.
+    */
+    char* end;
+
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *value = (unsigned char)arg[1];
+        return 1;
+    }
+
+    errno = 0;
+    *value = strtoll(arg, &end, 0);
+    if (errno == ERANGE && *value == LLONG_MAX) {
+        *value = (long long)strtoull(arg, &end, 0);
+    }
+    if (end == arg || *end || errno) {
+        printf("printf: %s: invalid number\n", arg);
+        return 0;
+    }
+    return 1;
+}
+
+int printf_conversion(char** format, char*** args) {
+    /*
+    Writes the conversion specification starting after the % at format with the next argument from args.
+    Advances format past the specification and args past the arguments used. Missing arguments are empty or 0.
+    Returns 1 if an argument was invalid, -1 if \c in a %b argument stopped the output, otherwise 0.
+    */
+    char spec[SPEC_SIZE + 16];
+    char* s = *format;
+    int len = 0;
+    int error = 0;
+    long long value;
+    double real;
+
+    spec[len++] = '%';
+    while (*s && len < SPEC_SIZE && strchr("-+ #0123456789.*", *s)) {
+        // * takes the field width or precision from the next argument
+        if (*s == '*') {
+            char* arg = **args ? *(*args)++ : "0";
+            error |= !printf_number(arg, &value);
+            len += snprintf(spec + len, sizeof(spec) - len, "%d", (int)value);
+            s++;
+        }
+        else {
+            spec[len++] = *s++;
+        }
+    }
+
+    // length modifiers as in %ld or %zu are accepted and ignored, numbers are always converted as long long
+    while (*s && strchr("hlLqjzt", *s)) {
+        s++;
+    }
+
+    char conversion = *s ? *s++ : '\0';
+    char* arg = conversion != '%' && **args ? *(*args)++ : NULL;
+    *format = s;
+
+    switch (conversion) {
+        case 'd':
+        case 'i':
+        case 'o':
+        case 'u':
+        case 'x':
+        case 'X':
+            value = 0;
+            if (arg) {
+                error |= !printf_number(arg, &value);
+            }
+            spec[len++] = 'l';
+            spec[len++] = 'l';
+            spec[len++] = conversion;
+            spec[len] = '\0';
+            printf(spec, value);
+            break;
+
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            real = 0;
+            if (arg) {
+                char* end;
+                real = strtod(arg, &end);
+                if (end == arg || *end) {
+                    printf("printf: %s: invalid number\n", arg);
+                    error = 1;
+                }
+            }
+            spec[len++] = conversion;
+            spec[len] = '\0';
+            printf(spec, real);
+            break;
+
+        case 'c':
+            // an empty argument has no character to print, not even a NUL, only its field width is filled
+            spec[len++] = arg && arg[0] ? 'c' : 's';
+            spec[len] = '\0';
+            if (arg && arg[0]) {
+                printf(spec, arg[0]);
+            }
+            else {
+                printf(spec, "");
+            }
+            break;
+
+        case 's':
+            spec[len++] = 's';
+            spec[len] = '\0';
+            printf(spec, arg ? arg : "");
+            break;
+
+        case 'b':
+            if (arg && put_escaped(arg)) {
+                return -1;
+            }
+            break;
+
+        case '%':
+            putchar('%');
+            break;
+
+        default:
+            printf("printf: %%%c: invalid conversion\n", conversion);
+            return 1;
+    }
+    return error;
+}
+
+int printf_utility(char** args) {
+    /*
+    Writes its arguments under the control of the format given as the first argument.
+    The format is used again as long as arguments remain and it consumed some.
+    */
+    char* format = args[1];
+    char** next_arg;
+    int exit_value = 0;
+    int stop = 0;
+
+    if (format == NULL) {
+        printf("printf: missing format\n");
+        return 1;
+    }
+    next_arg = &args[2];
+
+    do {
+        char** first_arg = next_arg;
+        char* f = format;
+
+        while (*f && !stop) {
+            if (*f == '%') {
+                f++;
+                int result = printf_conversion(&f, &next_arg);
+                if (result == -1) {
+                    return exit_value;
+                }
+                exit_value |= result;
+            }
+            else if (*f == '\\' && f[1]) {
+                f = put_escape(f + 1, 1, &stop);
+            }
+            else {
+                putchar(*f++);
+            }
+        }
+
+        // the format takes no arguments, the rest are ignored
+        if (next_arg == first_arg) {
+            break;
+        }
+    } while (*next_arg && !stop);
+
+    return exit_value;
+}
+
+int test_integer(char* arg, long long* value) {
+    // Converts an operand of a numeric comparison, returns 0 after printing an error if it isn't an integer
+    char* end;
+
+    errno = 0;
+    *value = strtoll(arg, &end, 10);
+    if (end == arg || *end || errno) {
+        printf("test: %s: integer expression expected\n", arg);
+        return 0;
+    }
+    return 1;
+}
+
+int test_unary(char* op, char* operand) {
+    /*
+    Evaluates a unary expression: a file test or a string length test.
+    Returns 0 if true, 1 if false, 2 if op isn't a unary operator.
+    */
+    struct stat info;
+    int found;
+
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+        return 2;
+    }
+
+    switch (op[1]) {
+        case 'z': return operand[0] != '\0';
+        case 'n': return operand[0] == '\0';
+        case 'r': return access(operand, R_OK) != 0;
+        case 'w': return access(operand, W_OK) != 0;
+        case 'x': return access(operand, X_OK) != 0;
+        case 'h':
+        case 'L': return lstat(operand, &info) != 0 || !S_ISLNK(info.st_mode);
+    }
+
+    found = stat(operand, &info) == 0;
+    switch (op[1]) {
+        case 'e': return !found;
+        case 'f': return !found || !S_ISREG(info.st_mode);
+        case 'd': return !found || !S_ISDIR(info.st_mode);
+        case 'b': return !found || !S_ISBLK(info.st_mode);
+        case 'c': return !found || !S_ISCHR(info.st_mode);
+        case 'p': return !found || !S_ISFIFO(info.st_mode);
+        case 'S': return !found || !S_ISSOCK(info.st_mode);
+        case 's': return !found || info.st_size == 0;
+        case 'u': return !found || !(info.st_mode & S_ISUID);
+        case 'g': return !found || !(info.st_mode & S_ISGID);
+        case 'k': return !found || !(info.st_mode & S_ISVTX);
+    }
+    return 2;
+}
+
+int test_binary(char* left, char* op, char* right) {
+    /*
+    Evaluates a binary expression: a string or an integer comparison.
+    Returns 0 if true, 1 if false, 2 if op isn't a binary operator or an operand isn't an integer (the error is printed).
+    */
+    char* int_ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge"};
+    long long a;
+    long long b;
+    int i;
+
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) != 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) == 0;
+    }
+
+    for (i = 0; i < 6 && strcmp(op, int_ops[i]) != 0; i++);
+    if (i == 6) {
+        printf("test: %s: binary operator expected\n", op);
+        return 2;
+    }
+    if (!test_integer(left, &a) || !test_integer(right, &b)) {
+        return 2;
+    }
+
+    switch (i) {
+        case 0: return !(a == b);
+        case 1: return !(a != b);
+        case 2: return !(a < b);
+        case 3: return !(a <= b);
+        case 4: return !(a > b);
+        default: return !(a >= b);
+    }
+}
+
+int test_expression(char** args, int num_args) {
+    /*
+    Evaluates the POSIX test expression made of num_args arguments, dispatching on their number.
+    Returns 0 if true, 1 if false, 2 on error.
+    */
+    int result;
+
+    switch (num_args) {
+        // no expression is false, a single argument is true if it isn't empty
+        case 0:
+            return 1;
+        case 1:
+            return args[0][0] == '\0';
+
+        case 2:
+            if (strcmp(args[0], "!") == 0) {
+                return args[1][0] != '\0';
+            }
+            result = test_unary(args[0], args[1]);
+            if (result == 2) {
+                printf("test: %s: unary operator expected\n", args[0]);
+            }
+            return result;
+
+        // a binary expression, unless it starts with ! and its operator isn't a string comparison
+        case 3:
+            if (strcmp(args[0], "!") != 0 || strcmp(args[1], "=") == 0 || strcmp(args[1], "!=") == 0) {
+                return test_binary(args[0], args[1], args[2]);
+            }
+            break;
+    }
+
+    // a leading ! negates the rest of the expression
+    if (strcmp(args[0], "!") == 0) {
+        result = test_expression(args + 1, num_args - 1);
+        return result == 2 ? 2 : !result;
+    }
+    printf("test: too many arguments\n");
+    return 2;
+}
+
+int test_utility(char** args) {
+    /*
+    Evaluates a conditional expression, exits with 0 if it is true and 1 if it is false.
+    Called as [, the last argument must be ].
+    */
+    int num_args = 0;
+
+    while (args[num_args + 1]) {
+        num_args++;
+    }
+
+    if (strcmp(args[0], "[") == 0) {
+        if (num_args == 0 || strcmp(args[num_args], "]") != 0) {
+            printf("[: missing ]\n");
+            return 2;
+        }
+        num_args--;
+    }
+    return test_expression(args + 1, num_args);
+}
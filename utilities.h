@@ -0,0 +1,12 @@
+#ifndef UTILITIES_H
+#define UTILITIES_H
+
+// Utilities run inside the shell instead of executing a program, each returns its exit value
+int echo_utility(char** args);
+int true_utility(char** args);
+int false_utility(char** args);
+int pwd_utility(char** args);
+int printf_utility(char** args);
+int test_utility(char** args);
+
+#endif
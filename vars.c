@@ -0,0 +1,389 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "cmdhash.h"
+#include "vars.h"
+
+#define INITIAL_VARIABLES 64        // slots allocated at startup, the table doubles when 3/4 full
+#define INITIAL_ENVIRONMENT 64      // environment entries allocated at startup, doubled as needed
+
+/*
+Shell variables live in an open-addressing table keyed by name. Exported variables also have a "NAME=value" entry
+in an environment array kept up to date as they change, and environ points at that array, so exec passes it to
+children without building it on every spawn. Variables are never removed, so the table needs no removed markers.
+The values of $$, $?, and $! are rendered when they change, not when they are expanded.
+*/
+typedef struct Variable {
+    char* name;                 // NULL for an empty slot
+    char* value;
+    int env_index;              // index of the variable's entry in environment, -1 if it isn't exported
+} Variable;
+
+extern char** environ;
+
+Variable* variables = NULL;
+int num_variable_slots = 0;
+int num_variables = 0;
+
+char** environment = NULL;      // NULL-terminated "NAME=value" of every exported variable, environ points here
+int environment_size = 0;
+int environment_capacity = 0;
+
+char pid_string[16];            // $$
+char status_string[16] = "0";   // $?
+char background_string[16];     // $!, empty until a command runs in the background
+
+char* (*run_substitution)(char* commands, Arena* arena) = NULL;
+
+unsigned long hash_var(char* name, size_t name_len) {
+    // FNV-1a hash of a variable name
+    unsigned long hash = 14695981039346656037UL;
+    size_t i;
+
+    for (i = 0; i < name_len; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211UL;
+    }
+    return hash;
+}
+
+Variable* find_var_slot(char* name, size_t name_len) {
+    // Returns the slot holding name, or the empty slot it would go in
+    unsigned long i = hash_var(name, name_len) & (num_variable_slots - 1);
+
+    while (variables[i].name != NULL
+           && (strncmp(variables[i].name, name, name_len) != 0 || variables[i].name[name_len] != '\0')) {
+        i = (i + 1) & (num_variable_slots - 1);
+    }
+    return &variables[i];
+}
+
+void resize_variables(int new_num_slots) {
+    // Moves every variable to a new table
+    Variable* old_variables = variables;
+    int old_num_slots = num_variable_slots;
+    int i;
+
+    variables = calloc(new_num_slots, sizeof(Variable));
+    num_variable_slots = new_num_slots;
+
+    for (i = 0; i < old_num_slots; i++) {
+        if (old_variables[i].name != NULL) {
+            *find_var_slot(old_variables[i].name, strlen(old_variables[i].name)) = old_variables[i];
+        }
+    }
+    free(old_variables);
+}
+
+char* make_entry(char* name, char* value) {
+    // Returns "name=value" allocated with malloc
+    char* entry = malloc(strlen(name) + strlen(value) + 2);
+    sprintf(entry, "%s=%s", name, value);
+    return entry;
+}
+
+void set_var(char* name, size_t name_len, char* value, int export) {
+    /*
+    Sets the variable called name (name_len characters of name) to value, both are copied.
+    With export, the variable is also put in the environment of commands. A variable stays exported once it is.
+    */
+    if ((num_variables + 1) * 4 > num_variable_slots * 3) {
+        resize_variables(num_variable_slots * 2);
+    }
+
+    Variable* var = find_var_slot(name, name_len);
+    if (var->name == NULL) {
+        var->name = strndup(name, name_len);
+        var->env_index = -1;
+        num_variables++;
+    }
+    // value may be the variable's own, copied before the old one is freed
+    char* copy = strdup(value);
+    free(var->value);
+    var->value = copy;
+
+    // paths remembered from the old PATH may no longer be the ones it finds
+    if (strcmp(var->name, "PATH") == 0) {
+        hash_clear();
+    }
+
+    if (var->env_index == -1 && !export) {
+        return;
+    }
+
+    // only the variable's own entry changes, the rest of the environment is left as it is
+    if (var->env_index == -1) {
+        if (environment_size + 1 == environment_capacity) {
+            environment_capacity *= 2;
+            environment = realloc(environment, environment_capacity * sizeof(char*));
+            environ = environment;
+        }
+        var->env_index = environment_size++;
+        environment[environment_size] = NULL;
+    }
+    else {
+        free(environment[var->env_index]);
+    }
+    environment[var->env_index] = make_entry(var->name, var->value);
+}
+
+char* get_var(char* name, size_t name_len) {
+    // Returns the value of the variable called name (name_len characters of name), or NULL if it isn't set
+    Variable* var = find_var_slot(name, name_len);
+    return var->name ? var->value : NULL;
+}
+
+void vars_init(pid_t shell_pid) {
+    /*
+    Imports the environment the shell was started with as exported variables and renders $$.
+    */
+    char** entry;
+
+    variables = calloc(INITIAL_VARIABLES, sizeof(Variable));
+    num_variable_slots = INITIAL_VARIABLES;
+    environment = calloc(INITIAL_ENVIRONMENT, sizeof(char*));
+    environment_capacity = INITIAL_ENVIRONMENT;
+
+    char** inherited = environ;
+    environ = environment;
+    for (entry = inherited; entry && *entry; entry++) {
+        char* equals = strchr(*entry, '=');
+        if (equals) {
+            set_var(*entry, equals - *entry, equals + 1, 1);
+        }
+    }
+
+    sprintf(pid_string, "%d", shell_pid);
+}
+
+int is_assignment(char* word) {
+    // Checks if word has the form NAME=value
+    int len = name_length(word);
+    return len > 0 && word[len] == '=';
+}
+
+void assign(char* word, int export) {
+    // Sets a variable from a word of the form NAME=value, exporting it if export is 1
+    char* equals = strchr(word, '=');
+    set_var(word, equals - word, equals + 1, export);
+}
+
+void print_exported(FILE* stream) {
+    // Prints every exported variable, as export would be given it
+    int i;
+
+    for (i = 0; i < environment_size; i++) {
+        fprintf(stream, "export %s\n", environment[i]);
+    }
+}
+
+char** environment_with(char** assigns, int num_assigns) {
+    /*
+    Returns the environment with the NAME=value assignments given before a command added or replacing the
+    variables of the same name, for that command only. The array is allocated with malloc, its strings are
+    the environment's own and the assignments.
+    */
+    char** env = malloc((environment_size + num_assigns + 1) * sizeof(char*));
+    int size = environment_size;
+    int i;
+    int j;
+
+    memcpy(env, environment, environment_size * sizeof(char*));
+    for (i = 0; i < num_assigns; i++) {
+        size_t name_len = strchr(assigns[i], '=') - assigns[i] + 1;
+
+        for (j = 0; j < size && strncmp(env[j], assigns[i], name_len) != 0; j++) {
+            ;
+        }
+        env[j] = assigns[i];
+        size += j == size;
+    }
+    env[size] = NULL;
+    return env;
+}
+
+void restore_environment() {
+    // Points environ back at the shell's environment after a built-in ran with one from environment_with
+    environ = environment;
+}
+
+void set_status_var(int status) {
+    // Renders $? from the status of the last foreground command
+    sprintf(status_string, "%d", WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+}
+
+void set_background_pid(pid_t pid) {
+    // Renders $! from the pid of the last command started in the background
+    sprintf(background_string, "%d", pid);
+}
+
+char* site_value(char* site, int length, Arena* arena) {
+    /*
+    Returns the value of one expansion, site is its text in a word: $$, $?, $!, $NAME, ${NAME},
+    ${NAME:-default}, ${NAME-default}, $(commands), or `commands`. Unset variables expand to nothing. A default 
+    and the output of commands are allocated from arena.
+    */
+    if (site[0] == '`' || site[1] == '(') {
+        int start = site[0] == '`' ? 1 : 2;
+        char* commands = arena_alloc(arena, length - start);
+        memcpy(commands, site + start, length - start - 1);
+        commands[length - start - 1] = '\0';
+        return run_substitution ? run_substitution(commands, arena) : "";
+    }
+
+    switch (site[1]) {
+        case '$': return pid_string;
+        case '?': return status_string;
+        case '!': return background_string;
+        case '{': break;
+        default: {
+            char* value = get_var(site + 1, length - 1);
+            return value ? value : "";
+        }
+    }
+
+    // ${NAME}, and with a default used when NAME is unset, or with ':-' also when it is empty
+    char* name = site + 2;
+    int name_len = name_length(name);
+    char* value = get_var(name, name_len);
+    char* rest = name + name_len;
+
+    if (*rest == '}') {
+        return value ? value : "";
+    }
+    int use_default = rest[0] == ':' ? value == NULL || *value == '\0' : value == NULL;
+    if (!use_default) {
+        return value;
+    }
+
+    char* start = rest + (rest[0] == ':' ? 2 : 1);
+    int default_len = site + length - 1 - start;
+    char* result = arena_alloc(arena, default_len + 1);
+    memcpy(result, start, default_len);
+    result[default_len] = '\0';
+    return result;
+}
+
+char** site_values(Token* word, size_t* length, Arena* arena) {
+    // Returns the value of every expansion of a word, in order, and sets length to the length of the expanded text
+    char** values = arena_alloc(arena, word->num_sites * sizeof(char*));
+    int i;
+
+    *length = strlen(word->text);
+    for (i = 0; i < word->num_sites; i++) {
+        values[i] = site_value(word->text + word->sites[i].offset, word->sites[i].length, arena);
+        *length += strlen(values[i]) - word->sites[i].length;
+    }
+    return values;
+}
+
+char* expand_word(Token* word, Arena* arena) {
+    /*
+    Returns the text of a word with every expansion recorded by the lexer replaced by its value.
+    Words without anything to expand are returned as they are, others are built in arena.
+    */
+    if (word->num_sites == 0) {
+        return word->text;
+    }
+
+    size_t len;
+    char** values = site_values(word, &len, arena);
+    char* expanded = arena_alloc(arena, len + 1);
+    char* out = expanded;
+    size_t copied = 0;          // characters of text already copied
+    int i;
+
+    for (i = 0; i < word->num_sites; i++) {
+        size_t site = word->sites[i].offset;
+        size_t value_len = strlen(values[i]);
+
+        memcpy(out, word->text + copied, site - copied);
+        out += site - copied;
+        memcpy(out, values[i], value_len);
+        out += value_len;
+        copied = site + word->sites[i].length;
+    }
+    strcpy(out, word->text + copied);
+    return expanded;
+}
+
+int expand_fields(Token* word, char*** fields, Arena* arena) {
+    /*
+    Expands a word into the arguments it stands for and sets fields to them, allocated from arena. The output of 
+    an unquoted command substitution is split at blanks and newlines, so the word may stand for several arguments,
+    or none if there is nothing else in it. Every other word stands for one.
+    Returns the number of arguments.
+    */
+    int i;
+
+    for (i = 0; i < word->num_sites && !word->sites[i].split; i++) {
+        ;
+    }
+    if (i == word->num_sites) {
+        *fields = arena_alloc(arena, sizeof(char*));
+        (*fields)[0] = expand_word(word, arena);
+        return 1;
+    }
+
+    // separators are replaced by the NUL ending each field, so the fields fit in the expanded length
+    size_t len;
+    char** values = site_values(word, &len, arena);
+    char* out = arena_alloc(arena, len + 1);
+    char* start = out;          // current field
+    int has_field = 0;          // 1 once the current field has anything in it
+    char** found = NULL;        // fields, grown with realloc while their number is unknown
+    int num_fields = 0;
+    int capacity = 0;
+    size_t copied = 0;
+
+    for (i = 0; i <= word->num_sites; i++) {
+        size_t site = i < word->num_sites ? (size_t)word->sites[i].offset : strlen(word->text);
+        char* value;
+
+        // text around the expansions belongs to the current field
+        if (site > copied) {
+            memcpy(out, word->text + copied, site - copied);
+            out += site - copied;
+            has_field = 1;
+        }
+        if (i == word->num_sites) {
+            break;
+        }
+
+        for (value = values[i]; *value; value++) {
+            if (!word->sites[i].split || (*value != ' ' && *value != '\t' && *value != '\n')) {
+                *out++ = *value;
+                has_field = 1;
+            }
+            else if (has_field) {
+                if (num_fields == capacity) {
+                    capacity = capacity ? capacity * 2 : 16;
+                    found = realloc(found, capacity * sizeof(char*));
+                }
+                *out++ = '\0';
+                found[num_fields++] = start;
+                start = out;
+                has_field = 0;
+            }
+        }
+        has_field |= !word->sites[i].split;
+        copied = site + word->sites[i].length;
+    }
+    if (has_field) {
+        if (num_fields == capacity) {
+            found = realloc(found, (capacity + 1) * sizeof(char*));
+        }
+        *out = '\0';
+        found[num_fields++] = start;
+    }
+
+    *fields = arena_alloc(arena, (num_fields + 1) * sizeof(char*));
+    if (num_fields > 0) {
+        memcpy(*fields, found, num_fields * sizeof(char*));
+    }
+    free(found);
+    return num_fields;
+}
@@ -0,0 +1,25 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "arena.h"
+#include "lexer.h"
+
+void vars_init(pid_t shell_pid);
+char* get_var(char* name, size_t name_len);
+void set_var(char* name, size_t name_len, char* value, int export);
+int is_assignment(char* word);
+void assign(char* word, int export);
+void print_exported(FILE* stream);
+char** environment_with(char** assigns, int num_assigns);
+void restore_environment();
+void set_status_var(int status);
+void set_background_pid(pid_t pid);
+char* expand_word(Token* word, Arena* arena);
+int expand_fields(Token* word, char*** fields, Arena* arena);
+
+// runs the commands of a $(...) or `...` and returns their output, set by the shell, NULL expands them to nothing
+extern char* (*run_substitution)(char* commands, Arena* arena);
+
+#endif